@@ -5,9 +5,18 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <queue>
 #include <stack>
+#include <thread>
+#include <vector>
 #include "btree.h"
 #include "filescan.h"
+#include "parallelscan.h"
 #include "exceptions/bad_index_info_exception.h"
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/bad_scanrange_exception.h"
@@ -15,7 +24,6 @@
 #include "exceptions/scan_not_initialized_exception.h"
 #include "exceptions/index_scan_completed_exception.h"
 #include "exceptions/file_not_found_exception.h"
-#include "exceptions/end_of_file_exception.h"
 #include "exceptions/file_exists_exception.h"
 #include "exceptions/page_pinned_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
@@ -27,11 +35,635 @@
 namespace badgerdb
 {
 
+// -----------------------------------------------------------------------------
+// Fixed size nodes (INTEGER and DOUBLE keys)
+// -----------------------------------------------------------------------------
+
+// Slots of a node are packed to the front of its arrays, so a leaf is full up to
+// its first rid with an invalid page number and a non-leaf up to its first
+// invalid child page number. Both are found by binary search.
+template <class T>
+int NonLeafNode<T>::size() const
+{
+	int lo = 0;
+	int hi = KeyTraits<T>::NONLEAFSIZE;
+	while (lo < hi) {
+		const int mid = (lo + hi) / 2;
+		if (pageNoArray[mid + 1] != Page::INVALID_NUMBER)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+template <class T>
+T NonLeafNode<T>::keyAt(const int i) const { return keyArray[i]; }
+
+template <class T>
+PageId NonLeafNode<T>::childAt(const int i) const { return pageNoArray[i]; }
+
+template <class T>
+int NonLeafNode<T>::lowerBound(const T& key) const { return badgerdb::lowerBound(keyArray, size(), key); }
+
+template <class T>
+int NonLeafNode<T>::upperBound(const T& key) const { return badgerdb::upperBound(keyArray, size(), key); }
+
+template <class T>
+bool NonLeafNode<T>::insertAt(const int pos, const PageKeyPair<T>& child)
+{
+	const int n = size();
+	if (n == KeyTraits<T>::NONLEAFSIZE)
+		return false;
+	for (int i = n; i > pos; i--) {
+		keyArray[i] = keyArray[i - 1];
+		pageNoArray[i + 1] = pageNoArray[i];
+	}
+	keyArray[pos] = child.key;
+	pageNoArray[pos + 1] = child.pageNo;
+	return true;
+}
+
+template <class T>
+void NonLeafNode<T>::getEntries(std::vector<T>& keys, std::vector<PageId>& children) const
+{
+	const int n = size();
+	keys.assign(keyArray, keyArray + n);
+	children.assign(pageNoArray, pageNoArray + n + 1);
+}
+
+template <class T>
+void NonLeafNode<T>::setEntries(const T* keys, const PageId* children, const int numKeys)
+{
+	pageNoArray[0] = children[0];
+	for (int i = 0; i < KeyTraits<T>::NONLEAFSIZE; i++) {
+		keyArray[i] = i < numKeys ? keys[i] : T();
+		pageNoArray[i + 1] = i < numKeys ? children[i + 1] : Page::INVALID_NUMBER;
+	}
+}
+
+template <class T>
+int NonLeafNode<T>::keyBytes(const T&) { return sizeof(T); }
+
+template <class T>
+int NonLeafNode<T>::bytesFor(const int numKeys, const int keyBytes) { return keyBytes + numKeys * sizeof(PageId); }
+
+template <class T>
+int NonLeafNode<T>::bytesUsed() const { return size() * (sizeof(T) + sizeof(PageId)); }
+
+template <class T>
+int LeafNode<T>::size() const
+{
+	int lo = 0;
+	int hi = KeyTraits<T>::LEAFSIZE;
+	while (lo < hi) {
+		const int mid = (lo + hi) / 2;
+		if (ridArray[mid].page_number != Page::INVALID_NUMBER)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+template <class T>
+bool LeafNode<T>::hasEntry(const int i) const
+{
+	return i < KeyTraits<T>::LEAFSIZE && ridArray[i].page_number != Page::INVALID_NUMBER;
+}
+
+template <class T>
+T LeafNode<T>::keyAt(const int i) const { return keyArray[i]; }
+
+template <class T>
+RecordId LeafNode<T>::ridAt(const int i) const { return ridArray[i]; }
+
+template <class T>
+int LeafNode<T>::lowerBound(const T& key) const { return badgerdb::lowerBound(keyArray, size(), key); }
+
+template <class T>
+int LeafNode<T>::upperBound(const T& key) const { return badgerdb::upperBound(keyArray, size(), key); }
+
+template <class T>
+bool LeafNode<T>::insertAt(const int pos, const RIDKeyPair<T>& entry)
+{
+	const int n = size();
+	if (n == KeyTraits<T>::LEAFSIZE)
+		return false;
+	for (int i = n; i > pos; i--) {
+		keyArray[i] = keyArray[i - 1];
+		ridArray[i] = ridArray[i - 1];
+	}
+	keyArray[pos] = entry.key;
+	ridArray[pos] = entry.rid;
+	return true;
+}
+
+template <class T>
+void LeafNode<T>::removeAt(const int pos)
+{
+	const int n = size();
+	for (int i = pos; i < n - 1; i++) {
+		keyArray[i] = keyArray[i + 1];
+		ridArray[i] = ridArray[i + 1];
+	}
+	const RecordId emptyRid = {Page::INVALID_NUMBER, Page::INVALID_SLOT, 0};
+	keyArray[n - 1] = T();
+	ridArray[n - 1] = emptyRid;
+}
+
+template <class T>
+void LeafNode<T>::getEntries(std::vector<RIDKeyPair<T> >& entries) const
+{
+	const int n = size();
+	entries.resize(n);
+	for (int i = 0; i < n; i++)
+		entries[i].set(ridArray[i], keyArray[i]);
+}
+
+template <class T>
+void LeafNode<T>::setEntries(const RIDKeyPair<T>* entries, const int count)
+{
+	const RecordId emptyRid = {Page::INVALID_NUMBER, Page::INVALID_SLOT, 0};
+	for (int i = 0; i < KeyTraits<T>::LEAFSIZE; i++) {
+		keyArray[i] = i < count ? entries[i].key : T();
+		ridArray[i] = i < count ? entries[i].rid : emptyRid;
+	}
+}
+
+template <class T>
+int LeafNode<T>::keyBytes(const T&) { return sizeof(T); }
+
+template <class T>
+int LeafNode<T>::sharedPrefix(const T&, const T&) { return 0; }
+
+template <class T>
+int LeafNode<T>::bytesFor(const int count, const int keyBytes, const int)
+{
+	return keyBytes + count * sizeof(RecordId);
+}
+
+template <class T>
+int LeafNode<T>::bytesUsed() const { return size() * (sizeof(T) + sizeof(RecordId)); }
+
+// -----------------------------------------------------------------------------
+// Variable size nodes (STRING keys)
+// -----------------------------------------------------------------------------
+
+// Slots are packed byte by byte, so their fields are read and written with
+// memcpy. A key is stored without its NUL padding.
+
+static int keyLength(const StringKey& key)
+{
+	return strnlen(key.data, STRINGSIZE);
+}
+
+static int commonPrefix(const char* s1, const char* s2, const int n)
+{
+	int i = 0;
+	while (i < n && s1[i] == s2[i])
+		i++;
+	return i;
+}
+
+// Compare the n stored bytes of a key with key.data[0, n), telling a stored key
+// that is a proper prefix of key apart from an equal one.
+static int compareStored(const char* stored, const int n, const char* key, const int keyRest)
+{
+	const int c = memcmp(stored, key, n);
+	if (c != 0)
+		return c;
+	return n < keyRest && key[n] != '\0' ? -1 : 0;
+}
+
+int NonLeafNode<StringKey>::size() const { return numKeys; }
+
+StringKey NonLeafNode<StringKey>::keyAt(const int i) const
+{
+	const char* slot = data + i * STRINGNONLEAFSLOTSIZE;
+	std::uint16_t offset;
+	std::uint8_t length;
+	memcpy(&offset, slot + sizeof(PageId), sizeof(offset));
+	memcpy(&length, slot + sizeof(PageId) + sizeof(offset), sizeof(length));
+
+	StringKey key;
+	memset(key.data, 0, STRINGSIZE);
+	memcpy(key.data, data + offset, length);
+	return key;
+}
+
+PageId NonLeafNode<StringKey>::childAt(const int i) const
+{
+	if (i == 0)
+		return firstPageNo;
+	PageId pageNo;
+	memcpy(&pageNo, data + (i - 1) * STRINGNONLEAFSLOTSIZE, sizeof(pageNo));
+	return pageNo;
+}
+
+int NonLeafNode<StringKey>::compareKey(const int i, const StringKey& key) const
+{
+	const char* slot = data + i * STRINGNONLEAFSLOTSIZE;
+	std::uint16_t offset;
+	std::uint8_t length;
+	memcpy(&offset, slot + sizeof(PageId), sizeof(offset));
+	memcpy(&length, slot + sizeof(PageId) + sizeof(offset), sizeof(length));
+	return compareStored(data + offset, length, key.data, STRINGSIZE);
+}
+
+int NonLeafNode<StringKey>::lowerBound(const StringKey& key) const
+{
+	int lo = 0;
+	int hi = numKeys;
+	while (lo < hi) {
+		const int mid = (lo + hi) / 2;
+		if (compareKey(mid, key) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+int NonLeafNode<StringKey>::upperBound(const StringKey& key) const
+{
+	int lo = 0;
+	int hi = numKeys;
+	while (lo < hi) {
+		const int mid = (lo + hi) / 2;
+		if (compareKey(mid, key) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+bool NonLeafNode<StringKey>::insertAt(const int pos, const PageKeyPair<StringKey>& child)
+{
+	const std::uint8_t length = keyLength(child.key);
+	if ((numKeys + 1) * STRINGNONLEAFSLOTSIZE + length > heapOffset)
+		return false;
+
+	heapOffset -= length;
+	memcpy(data + heapOffset, child.key.data, length);
+
+	char* slot = data + pos * STRINGNONLEAFSLOTSIZE;
+	memmove(slot + STRINGNONLEAFSLOTSIZE, slot, (numKeys - pos) * STRINGNONLEAFSLOTSIZE);
+	memcpy(slot, &child.pageNo, sizeof(PageId));
+	memcpy(slot + sizeof(PageId), &heapOffset, sizeof(heapOffset));
+	memcpy(slot + sizeof(PageId) + sizeof(heapOffset), &length, sizeof(length));
+	numKeys++;
+	return true;
+}
+
+void NonLeafNode<StringKey>::getEntries(std::vector<StringKey>& keys, std::vector<PageId>& children) const
+{
+	keys.resize(numKeys);
+	children.resize(numKeys + 1);
+	children[0] = firstPageNo;
+	for (int i = 0; i < numKeys; i++) {
+		keys[i] = keyAt(i);
+		children[i + 1] = childAt(i + 1);
+	}
+}
+
+void NonLeafNode<StringKey>::setEntries(const StringKey* keys, const PageId* children, const int numKeys)
+{
+	this->numKeys = 0;
+	this->heapOffset = STRINGNONLEAFDATASIZE;
+	this->firstPageNo = children[0];
+	for (int i = 0; i < numKeys; i++) {
+		PageKeyPair<StringKey> child;
+		child.set(children[i + 1], keys[i]);
+		insertAt(i, child);
+	}
+}
+
+int NonLeafNode<StringKey>::keyBytes(const StringKey& key) { return keyLength(key); }
+
+int NonLeafNode<StringKey>::bytesFor(const int numKeys, const int keyBytes)
+{
+	return keyBytes + numKeys * STRINGNONLEAFSLOTSIZE;
+}
+
+int NonLeafNode<StringKey>::bytesUsed() const
+{
+	return numKeys * STRINGNONLEAFSLOTSIZE + STRINGNONLEAFDATASIZE - heapOffset;
+}
+
+int LeafNode<StringKey>::size() const { return numKeys; }
+
+bool LeafNode<StringKey>::hasEntry(const int i) const { return i < numKeys; }
+
+StringKey LeafNode<StringKey>::keyAt(const int i) const
+{
+	const char* slot = data + i * STRINGLEAFSLOTSIZE;
+	std::uint16_t offset;
+	std::uint8_t length;
+	memcpy(&offset, slot + sizeof(PageId) + sizeof(SlotId), sizeof(offset));
+	memcpy(&length, slot + sizeof(PageId) + sizeof(SlotId) + sizeof(offset), sizeof(length));
+
+	StringKey key;
+	memset(key.data, 0, STRINGSIZE);
+	memcpy(key.data, prefix, prefixLength);
+	memcpy(key.data + prefixLength, data + offset, length);
+	return key;
+}
+
+RecordId LeafNode<StringKey>::ridAt(const int i) const
+{
+	const char* slot = data + i * STRINGLEAFSLOTSIZE;
+	RecordId rid;
+	memcpy(&rid.page_number, slot, sizeof(PageId));
+	memcpy(&rid.slot_number, slot + sizeof(PageId), sizeof(SlotId));
+	rid.padding = 0;
+	return rid;
+}
+
+int LeafNode<StringKey>::compareSuffix(const int i, const StringKey& key) const
+{
+	const char* slot = data + i * STRINGLEAFSLOTSIZE;
+	std::uint16_t offset;
+	std::uint8_t length;
+	memcpy(&offset, slot + sizeof(PageId) + sizeof(SlotId), sizeof(offset));
+	memcpy(&length, slot + sizeof(PageId) + sizeof(SlotId) + sizeof(offset), sizeof(length));
+	return compareStored(data + offset, length, key.data + prefixLength, STRINGSIZE - prefixLength);
+}
+
+// A key below or above the shared prefix sorts before or after every entry, so
+// only keys starting with the prefix need a search over the suffixes.
+int LeafNode<StringKey>::lowerBound(const StringKey& key) const
+{
+	const int c = memcmp(key.data, prefix, prefixLength);
+	if (c != 0)
+		return c < 0 ? 0 : numKeys;
+
+	int lo = 0;
+	int hi = numKeys;
+	while (lo < hi) {
+		const int mid = (lo + hi) / 2;
+		if (compareSuffix(mid, key) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+int LeafNode<StringKey>::upperBound(const StringKey& key) const
+{
+	const int c = memcmp(key.data, prefix, prefixLength);
+	if (c != 0)
+		return c < 0 ? 0 : numKeys;
+
+	int lo = 0;
+	int hi = numKeys;
+	while (lo < hi) {
+		const int mid = (lo + hi) / 2;
+		if (compareSuffix(mid, key) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+bool LeafNode<StringKey>::insertAt(const int pos, const RIDKeyPair<StringKey>& entry)
+{
+	if (numKeys == 0) {
+		setEntries(&entry, 1);
+		return true;
+	}
+
+	const int length = keyLength(entry.key);
+	const int shared = commonPrefix(prefix, entry.key.data, std::min((int)prefixLength, length));
+	if (shared < prefixLength) {
+		//The prefix shrinks and every stored suffix grows by what is cut off it, so re-encode the leaf
+		const int used = numKeys * STRINGLEAFSLOTSIZE + (STRINGLEAFDATASIZE - heapOffset);
+		if (used + numKeys * (prefixLength - shared) + STRINGLEAFSLOTSIZE + length - shared > STRINGLEAFDATASIZE)
+			return false;
+		std::vector<RIDKeyPair<StringKey> > entries;
+		getEntries(entries);
+		entries.insert(entries.begin() + pos, entry);
+		setEntries(&entries[0], entries.size());
+		return true;
+	}
+	return insertSuffix(pos, entry);
+}
+
+// Insert an entry whose key starts with the prefix of the leaf.
+bool LeafNode<StringKey>::insertSuffix(const int pos, const RIDKeyPair<StringKey>& entry)
+{
+	const std::uint8_t suffixLength = keyLength(entry.key) - prefixLength;
+	if ((numKeys + 1) * STRINGLEAFSLOTSIZE + suffixLength > heapOffset)
+		return false;
+
+	heapOffset -= suffixLength;
+	memcpy(data + heapOffset, entry.key.data + prefixLength, suffixLength);
+
+	char* slot = data + pos * STRINGLEAFSLOTSIZE;
+	memmove(slot + STRINGLEAFSLOTSIZE, slot, (numKeys - pos) * STRINGLEAFSLOTSIZE);
+	memcpy(slot, &entry.rid.page_number, sizeof(PageId));
+	memcpy(slot + sizeof(PageId), &entry.rid.slot_number, sizeof(SlotId));
+	memcpy(slot + sizeof(PageId) + sizeof(SlotId), &heapOffset, sizeof(heapOffset));
+	memcpy(slot + sizeof(PageId) + sizeof(SlotId) + sizeof(heapOffset), &suffixLength, sizeof(suffixLength));
+	numKeys++;
+	return true;
+}
+
+// Rebuilding the leaf drops the removed suffix from the heap and may lengthen the prefix.
+void LeafNode<StringKey>::removeAt(const int pos)
+{
+	std::vector<RIDKeyPair<StringKey> > entries;
+	getEntries(entries);
+	entries.erase(entries.begin() + pos);
+	setEntries(entries.empty() ? NULL : &entries[0], entries.size());
+}
+
+void LeafNode<StringKey>::getEntries(std::vector<RIDKeyPair<StringKey> >& entries) const
+{
+	entries.resize(numKeys);
+	for (int i = 0; i < numKeys; i++)
+		entries[i].set(ridAt(i), keyAt(i));
+}
+
+void LeafNode<StringKey>::setEntries(const RIDKeyPair<StringKey>* entries, const int count)
+{
+	//The entries are sorted, so the prefix shared by the first and last key is shared by all of them
+	this->numKeys = 0;
+	this->heapOffset = STRINGLEAFDATASIZE;
+	this->prefixLength = count == 0 ? 0 : sharedPrefix(entries[0].key, entries[count - 1].key);
+	memset(prefix, 0, STRINGSIZE);
+	if (count > 0)
+		memcpy(prefix, entries[0].key.data, prefixLength);
+	for (int i = 0; i < count; i++)
+		insertSuffix(i, entries[i]);
+}
+
+int LeafNode<StringKey>::keyBytes(const StringKey& key) { return keyLength(key); }
+
+int LeafNode<StringKey>::sharedPrefix(const StringKey& k1, const StringKey& k2)
+{
+	return commonPrefix(k1.data, k2.data, std::min(keyLength(k1), keyLength(k2)));
+}
+
+int LeafNode<StringKey>::bytesFor(const int count, const int keyBytes, const int prefixLength)
+{
+	return keyBytes - count * prefixLength + count * STRINGLEAFSLOTSIZE;
+}
+
+int LeafNode<StringKey>::bytesUsed() const
+{
+	return numKeys * STRINGLEAFSLOTSIZE + STRINGLEAFDATASIZE - heapOffset;
+}
+
+// -----------------------------------------------------------------------------
+// Splitting
+// -----------------------------------------------------------------------------
+
+// True if the sorted entries [first, last) fit in one leaf.
+template <class T>
+static bool leafFits(const std::vector<RIDKeyPair<T> >& entries, const int first, const int last)
+{
+	int keyBytes = 0;
+	for (int i = first; i < last; i++)
+		keyBytes += LeafNode<T>::keyBytes(entries[i].key);
+	const int prefixLength = first == last ? 0 : LeafNode<T>::sharedPrefix(entries[first].key, entries[last - 1].key);
+	return LeafNode<T>::bytesFor(last - first, keyBytes, prefixLength) <= LeafNode<T>::CAPACITY;
+}
+
+// True if the keys [first, last) fit in one non-leaf.
+template <class T>
+static bool nonLeafFits(const std::vector<T>& keys, const int first, const int last)
+{
+	int keyBytes = 0;
+	for (int i = first; i < last; i++)
+		keyBytes += NonLeafNode<T>::keyBytes(keys[i]);
+	return NonLeafNode<T>::bytesFor(last - first, keyBytes) <= NonLeafNode<T>::CAPACITY;
+}
+
+// Number of the sorted entries of an overfull leaf that stay in the left half:
+// the one closest to half of them for which both halves fit in a leaf. Such a
+// split always exists, at worst just before or after the new entry.
+template <class T>
+static int leafSplitPoint(const std::vector<RIDKeyPair<T> >& entries)
+{
+	const int total = entries.size();
+	std::vector<int> keyBytes(total + 1, 0);
+	for (int i = 0; i < total; i++)
+		keyBytes[i + 1] = keyBytes[i] + LeafNode<T>::keyBytes(entries[i].key);
+
+	auto fits = [&](const int first, const int last) {
+		const int prefixLength = LeafNode<T>::sharedPrefix(entries[first].key, entries[last - 1].key);
+		return LeafNode<T>::bytesFor(last - first, keyBytes[last] - keyBytes[first], prefixLength) <=
+			LeafNode<T>::CAPACITY;
+	};
+
+	const int mid = (total + 1) / 2;
+	for (int d = 0; d < total; d++) {
+		if (mid - d >= 1 && fits(0, mid - d) && fits(mid - d, total))
+			return mid - d;
+		if (mid + d < total && fits(0, mid + d) && fits(mid + d, total))
+			return mid + d;
+	}
+	return mid;
+}
+
+// Index of the key of an overfull non-leaf that is pushed up, chosen like
+// leafSplitPoint so that the keys left and right of it both fit in a node.
+template <class T>
+static int nonLeafSplitPoint(const std::vector<T>& keys)
+{
+	const int total = keys.size();
+	std::vector<int> keyBytes(total + 1, 0);
+	for (int i = 0; i < total; i++)
+		keyBytes[i + 1] = keyBytes[i] + NonLeafNode<T>::keyBytes(keys[i]);
+
+	auto fits = [&](const int first, const int last) {
+		return NonLeafNode<T>::bytesFor(last - first, keyBytes[last] - keyBytes[first]) <= NonLeafNode<T>::CAPACITY;
+	};
+
+	const int mid = total / 2;
+	for (int d = 0; d < total; d++) {
+		if (mid - d >= 1 && fits(0, mid - d) && fits(mid - d + 1, total))
+			return mid - d;
+		if (mid + d < total - 1 && fits(0, mid + d) && fits(mid + d + 1, total))
+			return mid + d;
+	}
+	return mid;
+}
+
+// Separator to put in the parent between a node whose last key is left and its
+// right sibling whose first key is right: any key in (left, right] will do.
+template <class T>
+static T shortestSeparator(const T&, const T& right)
+{
+	return right;
+}
+
+template <>
+StringKey shortestSeparator<StringKey>(const StringKey& left, const StringKey& right)
+{
+	//Keep right up to and including its first byte that differs from left
+	const int n = commonPrefix(left.data, right.data, STRINGSIZE);
+	StringKey separator;
+	memset(separator.data, 0, STRINGSIZE);
+	memcpy(separator.data, right.data, std::min(n + 1, STRINGSIZE));
+	return separator;
+}
+
+// Read a key of type T from a record or a scan parameter. Numeric keys inside
+// records are not necessarily aligned, and strings are cut or NUL-padded to
+// STRINGSIZE characters.
+template <class T>
+static T loadKey(const void* src)
+{
+	T key;
+	memcpy(&key, src, sizeof(T));
+	return key;
+}
+
+template <>
+StringKey loadKey<StringKey>(const void* src)
+{
+	StringKey key;
+	std::memset(key.data, 0, STRINGSIZE);
+	std::memcpy(key.data, src, strnlen((const char*)src, STRINGSIZE));
+	return key;
+}
+
+template <>
+int& BTreeIndex::lowVal<int>() { return this->lowValInt; }
+
+template <>
+double& BTreeIndex::lowVal<double>() { return this->lowValDouble; }
+
+template <>
+StringKey& BTreeIndex::lowVal<StringKey>() { return this->lowValString; }
+
+template <>
+int& BTreeIndex::highVal<int>() { return this->highValInt; }
+
+template <>
+double& BTreeIndex::highVal<double>() { return this->highValDouble; }
+
+template <>
+StringKey& BTreeIndex::highVal<StringKey>() { return this->highValString; }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::BTreeIndex -- Constructor
+// -----------------------------------------------------------------------------
+
 BTreeIndex::BTreeIndex(const std::string & relationName,
 		std::string & outIndexName,
 		BufMgr *bufMgrIn,
 		const int attrByteOffset,
-		const Datatype attrType)
+		const Datatype attrType,
+		const BuildMode buildMode,
+		const double fillFactor,
+		const double mergeThreshold,
+		const unsigned numThreads)
 {
 	//Get the index name
 	std::ostringstream idxStr;
@@ -40,106 +672,1313 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
 
 	//Set up members
 	this->scanExecuting = false;
-  	this->bufMgr = bufMgrIn;
+	this->bufMgr = bufMgrIn;
 	this->attributeType = attrType;
 	this->attrByteOffset = attrByteOffset;
-	this->leafOccupancy = 0;
-	this->nodeOccupancy = 0;
+	this->mergeThreshold = mergeThreshold;
+	switch (attrType) {
+	case INTEGER:
+		this->leafOccupancy = INTARRAYLEAFSIZE;
+		this->nodeOccupancy = INTARRAYNONLEAFSIZE;
+		break;
+	case DOUBLE:
+		this->leafOccupancy = DOUBLEARRAYLEAFSIZE;
+		this->nodeOccupancy = DOUBLEARRAYNONLEAFSIZE;
+		break;
+	case STRING:
+		this->leafOccupancy = STRINGARRAYLEAFSIZE;
+		this->nodeOccupancy = STRINGARRAYNONLEAFSIZE;
+		break;
+	}
+	this->currentPageNum = Page::INVALID_NUMBER;
+	this->currentPageData = NULL;
 
 	IndexMetaInfo* metaData;
 	Page *headerpg;
-	Page *rootpg;
 
 	try {
 		this->file = new BlobFile(outIndexName, false);
-		//File already exists, get the info 
+		//File already exists, get the info and make sure it describes the same index
 		this->headerPageNum = this->file->getFirstPageNo();
 		this->bufMgr->readPage(this->file, this->headerPageNum, headerpg);
+		metaData = (IndexMetaInfo*)headerpg;
+		const bool matches =
+			strncmp(metaData->relationName, relationName.c_str(), sizeof(metaData->relationName) - 1) == 0 &&
+			metaData->attrByteOffset == attrByteOffset &&
+			metaData->attrType == attrType;
+		this->rootPageNum = metaData->rootPageNo;
+		this->freePageNum = metaData->freePageNo;
+		this->bufMgr->unPinPage(this->file, this->headerPageNum, false);
+
+		if (!matches) {
+			this->bufMgr->flushFile(this->file);
+			delete this->file;
+			throw BadIndexInfoException("Meta page of " + outIndexName + " does not match the requested index");
+		}
+		return;
 	} catch (FileNotFoundException& e) {
 		//File needs to be created
-		this->file = new BlobFile(outIndexName, true);
-		this->headerPageNum = 1;
-		this->bufMgr->allocPage(file, this->headerPageNum, headerpg);
-		this->bufMgr->allocPage(file, this->rootPageNum, rootpg);
 	}
 
+	this->file = new BlobFile(outIndexName, true);
+	this->freePageNum = Page::INVALID_NUMBER;
+
+	allocNode(this->headerPageNum, headerpg);
 	metaData = (IndexMetaInfo*)headerpg;
-    metaData->attrByteOffset = attrByteOffset;
+	strncpy(metaData->relationName, relationName.c_str(), sizeof(metaData->relationName) - 1);
+	metaData->attrByteOffset = attrByteOffset;
 	metaData->attrType = attrType;
-	metaData->rootPageNo = this->rootPageNum;
-	strcpy(metaData->relationName, relationName.c_str());
-	this->rootPageNum = metaData->rootPageNo;
-	NonLeafNodeInt* root = (NonLeafNodeInt*) rootpg;
-	root->level = 1;
+	this->bufMgr->unPinPage(this->file, this->headerPageNum, true);
 
-	//Unpin the header and root pages, no longer needed in pool
+	//The destructor does not run when the constructor throws, so the file is let go of here
 	try {
-		this->bufMgr->unPinPage(file, headerPageNum, true);
-		this->bufMgr->unPinPage(file, rootPageNum, true);
-	} catch(PageNotPinnedException& e){ }
+		switch (attrType) {
+		case INTEGER:
+			build<int>(relationName, outIndexName, buildMode, fillFactor, numThreads);
+			break;
+		case DOUBLE:
+			build<double>(relationName, outIndexName, buildMode, fillFactor, numThreads);
+			break;
+		case STRING:
+			build<StringKey>(relationName, outIndexName, buildMode, fillFactor, numThreads);
+			break;
+		}
+	} catch (...) {
+		try {
+			this->bufMgr->flushFile(this->file);
+		} catch (BadgerDbException& e) { }
+		delete this->file;
+		throw;
+	}
+}
+
+template <class T>
+void BTreeIndex::build(const std::string& relationName, const std::string& indexName,
+		const BuildMode buildMode, const double fillFactor, const unsigned numThreads)
+{
+	if (buildMode == BULK_BUILD) {
+		bulkLoad<T>(relationName, indexName, fillFactor);
+		updateMeta();
+		return;
+	}
+	if (buildMode == PARALLEL_BUILD) {
+		parallelLoad<T>(relationName, fillFactor, numThreads);
+		updateMeta();
+		return;
+	}
+
+	//The root starts as a non-leaf with no keys and a single, empty leaf child
+	Page *rootpg;
+	Page *leafpg;
+	PageId leafPageNum;
+	allocNode(this->rootPageNum, rootpg);
+	allocNode(leafPageNum, leafpg);
 
-	//This part comes directly from main.cpp line 113-128
+	NonLeafNode<T>* root = (NonLeafNode<T>*)rootpg;
+	root->level = 1;
+	root->setEntries(NULL, &leafPageNum, 0);
+	((LeafNode<T>*)leafpg)->setEntries(NULL, 0);
+
+	//Unpin the root and leaf pages, no longer needed in pool
+	this->bufMgr->unPinPage(this->file, this->rootPageNum, true);
+	this->bufMgr->unPinPage(this->file, leafPageNum, true);
+	updateMeta();
+
+	//Insert an entry for every tuple in the base relation
 	FileScan fscan(relationName, bufMgr);
+	RecordId rid;
+	while (fscan.tryScanNext(rid)) {
+		RecordView record = fscan.getRecordView();
+		insertKey<T>(loadKey<T>(record.data() + this->attrByteOffset), rid);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::~BTreeIndex -- destructor
+// -----------------------------------------------------------------------------
+
+BTreeIndex::~BTreeIndex()
+{
 	try {
+		if (this->scanExecuting)
+			endScan();
+		this->bufMgr->flushFile(file);
+	} catch (BadgerDbException& e) { }
+	delete file;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::insertEntry
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::insertEntry(const void *key, const RecordId rid) 
+{
+	switch (this->attributeType) {
+	case INTEGER:
+		insertKey<int>(loadKey<int>(key), rid);
+		break;
+	case DOUBLE:
+		insertKey<double>(loadKey<double>(key), rid);
+		break;
+	case STRING:
+		insertKey<StringKey>(loadKey<StringKey>(key), rid);
+		break;
+	}
+}
+
+template <class T>
+void BTreeIndex::insertKey(const T& key, const RecordId rid)
+{
+	RIDKeyPair<T> entry;
+	entry.set(rid, key);
+
+	PageKeyPair<T> newChild;
+	if (insertNonLeaf<T>(this->rootPageNum, entry, newChild))
+		growRoot<T>(newChild);
+}
+
+void BTreeIndex::allocNode(PageId& pageNo, Page*& page)
+{
+	if (this->freePageNum == Page::INVALID_NUMBER) {
+		this->bufMgr->allocPage(this->file, pageNo, page);
+		memset(reinterpret_cast<char*>(page), 0, Page::SIZE);
+		return;
+	}
+
+	pageNo = this->freePageNum;
+	this->bufMgr->readPage(this->file, pageNo, page);
+	memcpy(&this->freePageNum, reinterpret_cast<char*>(page), sizeof(PageId));
+	memset(reinterpret_cast<char*>(page), 0, Page::SIZE);
+	updateMeta();
+}
+
+void BTreeIndex::freeNode(const PageId pageNo)
+{
+	Page* page;
+	this->bufMgr->readPage(this->file, pageNo, page);
+	memcpy(reinterpret_cast<char*>(page), &this->freePageNum, sizeof(PageId));
+	this->bufMgr->unPinPage(this->file, pageNo, true);
+
+	this->freePageNum = pageNo;
+	updateMeta();
+}
+
+void BTreeIndex::updateMeta()
+{
+	Page* headerpg;
+	this->bufMgr->readPage(this->file, this->headerPageNum, headerpg);
+	IndexMetaInfo* metaData = (IndexMetaInfo*)headerpg;
+	metaData->rootPageNo = this->rootPageNum;
+	metaData->freePageNo = this->freePageNum;
+	this->bufMgr->unPinPage(this->file, this->headerPageNum, true);
+}
+
+template <class T>
+bool BTreeIndex::insertNonLeaf(const PageId pageNo, const RIDKeyPair<T>& entry, PageKeyPair<T>& newChild)
+{
+	Page* page;
+	this->bufMgr->readPage(this->file, pageNo, page);
+	NonLeafNode<T>* node = (NonLeafNode<T>*)page;
+
+	//Child i holds keys in [keyAt(i-1), keyAt(i))
+	const int pos = node->upperBound(entry.key);
+	const PageId childPageNo = node->childAt(pos);
+	const bool childIsLeaf = node->level == 1;
+
+	//The node is only needed again if the child splits, so do not hold it during the descent
+	this->bufMgr->unPinPage(this->file, pageNo, false);
+
+	PageKeyPair<T> childSplit;
+	const bool childSplitOccurred = childIsLeaf ?
+		insertLeaf<T>(childPageNo, entry, childSplit) :
+		insertNonLeaf<T>(childPageNo, entry, childSplit);
+	if (!childSplitOccurred)
+		return false;
+
+	this->bufMgr->readPage(this->file, pageNo, page);
+	node = (NonLeafNode<T>*)page;
+
+	if (node->insertAt(pos, childSplit)) {
+		this->bufMgr->unPinPage(this->file, pageNo, true);
+		return false;
+	}
+
+	//Node is full: lay out all keys in order and push the middle one up
+	std::vector<T> keys;
+	std::vector<PageId> pages;
+	node->getEntries(keys, pages);
+	keys.insert(keys.begin() + pos, childSplit.key);
+	pages.insert(pages.begin() + pos + 1, childSplit.pageNo);
+	const int total = keys.size();
+	const int mid = nonLeafSplitPoint(keys);
+
+	PageId siblingPageNo;
+	Page* siblingPage;
+	allocNode(siblingPageNo, siblingPage);
+	NonLeafNode<T>* sibling = (NonLeafNode<T>*)siblingPage;
+	sibling->level = node->level;
+
+	node->setEntries(&keys[0], &pages[0], mid);
+	sibling->setEntries(&keys[mid + 1], &pages[mid + 1], total - mid - 1);
+
+	newChild.set(siblingPageNo, keys[mid]);
+
+	this->bufMgr->unPinPage(this->file, pageNo, true);
+	this->bufMgr->unPinPage(this->file, siblingPageNo, true);
+	return true;
+}
+
+template <class T>
+bool BTreeIndex::insertLeaf(const PageId pageNo, const RIDKeyPair<T>& entry, PageKeyPair<T>& newChild)
+{
+	Page* page;
+	this->bufMgr->readPage(this->file, pageNo, page);
+	LeafNode<T>* leaf = (LeafNode<T>*)page;
+
+	//Equal keys go after the ones already present
+	const int pos = leaf->upperBound(entry.key);
+	if (leaf->insertAt(pos, entry)) {
+		this->bufMgr->unPinPage(this->file, pageNo, true);
+		return false;
+	}
+
+	//Leaf is full: the left half keeps about half of the entries, and a separator between
+	//the two halves is copied up
+	std::vector<RIDKeyPair<T> > entries;
+	leaf->getEntries(entries);
+	entries.insert(entries.begin() + pos, entry);
+	const int total = entries.size();
+	const int mid = leafSplitPoint(entries);
+
+	PageId siblingPageNo;
+	Page* siblingPage;
+	allocNode(siblingPageNo, siblingPage);
+	LeafNode<T>* sibling = (LeafNode<T>*)siblingPage;
+
+	leaf->setEntries(&entries[0], mid);
+	sibling->setEntries(&entries[mid], total - mid);
+
+	sibling->rightSibPageNo = leaf->rightSibPageNo;
+	leaf->rightSibPageNo = siblingPageNo;
+
+	newChild.set(siblingPageNo, shortestSeparator(entries[mid - 1].key, entries[mid].key));
+
+	this->bufMgr->unPinPage(this->file, pageNo, true);
+	this->bufMgr->unPinPage(this->file, siblingPageNo, true);
+	return true;
+}
+
+template <class T>
+void BTreeIndex::growRoot(const PageKeyPair<T>& newChild)
+{
+	PageId newRootPageNum;
+	Page* newRootPage;
+	allocNode(newRootPageNum, newRootPage);
+
+	//The old root was a non-leaf, so the new root is never directly above the leaves
+	NonLeafNode<T>* newRoot = (NonLeafNode<T>*)newRootPage;
+	newRoot->level = 0;
+	const PageId children[2] = {this->rootPageNum, newChild.pageNo};
+	newRoot->setEntries(&newChild.key, children, 1);
+	this->bufMgr->unPinPage(this->file, newRootPageNum, true);
+
+	this->rootPageNum = newRootPageNum;
+	updateMeta();
+}
+
+// -----------------------------------------------------------------------------
+// Bulk loading
+// -----------------------------------------------------------------------------
+
+// Sorted runs are spilled back to back into a temporary blob file, each page
+// holding a packed array of key-rid pairs.
+template <class T>
+struct RunPage {
+	static const std::size_t ENTRIES = Page::SIZE / sizeof(RIDKeyPair<T>);
+};
+
+//std::min takes its arguments by reference, so the constant needs a definition
+template <class T>
+const std::size_t RunPage<T>::ENTRIES;
+
+struct SortedRun {
+	PageId firstPageNo;
+	std::size_t numEntries;
+};
+
+template <class T>
+static void spillRun(BlobFile* runFile, std::vector<RIDKeyPair<T> >& entries, std::vector<SortedRun>& runs)
+{
+	std::sort(entries.begin(), entries.end());
+
+	SortedRun run;
+	run.firstPageNo = Page::INVALID_NUMBER;
+	run.numEntries = entries.size();
+	for (std::size_t i = 0; i < entries.size(); i += RunPage<T>::ENTRIES) {
+		PageId pageNo;
+		Page page = runFile->allocatePage(pageNo);
+		const std::size_t n = std::min(RunPage<T>::ENTRIES, entries.size() - i);
+		memcpy(reinterpret_cast<char*>(&page), &entries[i], n * sizeof(RIDKeyPair<T>));
+		runFile->writePage(pageNo, page);
+		if (i == 0)
+			run.firstPageNo = pageNo;
+	}
+	runs.push_back(run);
+	entries.clear();
+}
+
+// Reads a spilled run back one page at a time.
+template <class T>
+class RunReader {
+ public:
+	RunReader(BlobFile* runFile, const SortedRun& run)
+		: runFile_(runFile), nextPageNo_(run.firstPageNo), remaining_(run.numEntries), pos_(RunPage<T>::ENTRIES) {}
+
+	bool next(RIDKeyPair<T>& out)
+	{
+		if (remaining_ == 0)
+			return false;
+		if (pos_ == RunPage<T>::ENTRIES) {
+			runFile_->readPage(nextPageNo_++, page_);
+			pos_ = 0;
+		}
+		out = reinterpret_cast<const RIDKeyPair<T>*>(&page_)[pos_++];
+		remaining_--;
+		return true;
+	}
+
+ private:
+	BlobFile* runFile_;
+	PageId nextPageNo_;
+	std::size_t remaining_;
+	std::size_t pos_;
+	Page page_;
+};
+
+// Creates the run file when the first run is spilled, and closes and removes it however the bulk
+// load ends. A run file left behind by a build that crashed is removed first.
+class RunFileGuard {
+ public:
+	explicit RunFileGuard(const std::string& fileName) : fileName_(fileName), file_(NULL) {}
+
+	~RunFileGuard()
+	{
+		if (file_ == NULL)
+			return;
+		delete file_;
+		try {
+			File::remove(fileName_);
+		} catch (...) {
+			//Nothing more can be done about it while unwinding
+		}
+	}
+
+	BlobFile* get()
+	{
+		if (file_ == NULL) {
+			try {
+				File::remove(fileName_);
+			} catch (FileNotFoundException& e) {
+			}
+			file_ = new BlobFile(fileName_, true);
+		}
+		return file_;
+	}
+
+ private:
+	RunFileGuard(const RunFileGuard&) = delete;
+	RunFileGuard& operator=(const RunFileGuard&) = delete;
+
+	std::string fileName_;
+	BlobFile* file_;
+};
+
+template <class T>
+void BTreeIndex::bulkLoad(const std::string& relationName, const std::string& indexName, const double fillFactor)
+{
+	std::vector<RIDKeyPair<T> > entries;
+	std::vector<SortedRun> runs;
+	RunFileGuard runFile(indexName + ".runs");
+	std::size_t numEntries = 0;
+
+	{
+		FileScan fscan(relationName, bufMgr);
 		RecordId rid;
-		while (1) {
-			fscan.scanNext(rid);
-			std::string recordStr = fscan.getRecord();
-			const char *record = recordStr.c_str();
-			//call to insertEntry had that function been implemented
-			//insertEntry((int*)record + attrByteOffset, rid);
+		while (fscan.tryScanNext(rid)) {
+			RecordView record = fscan.getRecordView();
+			RIDKeyPair<T> entry;
+			entry.set(rid, loadKey<T>(record.data() + this->attrByteOffset));
+			entries.push_back(entry);
+			numEntries++;
+
+			if (entries.size() == (std::size_t)BULKLOADRUNSIZE) {
+				spillRun(runFile.get(), entries, runs);
+			}
 		}
-	} catch (EndOfFileException &e) {}
+	}
+
+	if (runs.empty()) {
+		std::sort(entries.begin(), entries.end());
+		std::size_t i = 0;
+		this->rootPageNum = packTree<T>([&](RIDKeyPair<T>& out) { out = entries[i++]; }, numEntries, fillFactor);
+		return;
+	}
+
+	if (!entries.empty())
+		spillRun(runFile.get(), entries, runs);
+	std::vector<RIDKeyPair<T> >().swap(entries);
+
+	//Merge the runs through a min-heap holding the head of every run
+	typedef std::pair<RIDKeyPair<T>, std::size_t> HeapItem;
+	struct HeapOrder {
+		bool operator()(const HeapItem& a, const HeapItem& b) const { return b.first < a.first; }
+	};
+	std::vector<RunReader<T> > readers;
+	std::priority_queue<HeapItem, std::vector<HeapItem>, HeapOrder> heap;
+	for (std::size_t r = 0; r < runs.size(); r++) {
+		readers.push_back(RunReader<T>(runFile.get(), runs[r]));
+		HeapItem item;
+		item.second = r;
+		if (readers[r].next(item.first))
+			heap.push(item);
+	}
+
+	this->rootPageNum = packTree<T>([&](RIDKeyPair<T>& out) {
+		HeapItem item = heap.top();
+		heap.pop();
+		out = item.first;
+		if (readers[item.second].next(item.first))
+			heap.push(item);
+	}, numEntries, fillFactor);
 }
 
-BTreeIndex::~BTreeIndex()
+template <class T, class NextEntry>
+PageId BTreeIndex::packTree(NextEntry next, const std::size_t numEntries, const double fillFactor)
+{
+	//Fill every node up to the fill factor's share of its bytes, taking at least one entry per
+	//leaf and two children per non-leaf so that every level shrinks
+	const double leafBudget = LeafNode<T>::CAPACITY * std::min(fillFactor, 1.0);
+
+	//Separator left of and page number of every node of the level being built
+	std::vector<PageKeyPair<T> > level;
+
+	//Entries of the leaf being filled
+	std::vector<RIDKeyPair<T> > pending;
+	int pendingKeyBytes = 0;
+
+	PageId prevPageNo = Page::INVALID_NUMBER;
+	Page* prevPage = NULL;
+	T prevLastKey = T();
+	auto flushLeaf = [&]() {
+		PageId pageNo;
+		Page* page;
+		allocNode(pageNo, page);
+		LeafNode<T>* leaf = (LeafNode<T>*)page;
+		leaf->setEntries(pending.empty() ? NULL : &pending[0], pending.size());
+
+		PageKeyPair<T> child;
+		child.set(pageNo, prevPage == NULL || pending.empty() ? T() :
+			shortestSeparator(prevLastKey, pending.front().key));
+		level.push_back(child);
+
+		//Leaves are allocated left to right, so the previous one can be linked and released
+		if (prevPage != NULL) {
+			((LeafNode<T>*)prevPage)->rightSibPageNo = pageNo;
+			this->bufMgr->unPinPage(this->file, prevPageNo, true);
+		}
+		prevPageNo = pageNo;
+		prevPage = page;
+		if (!pending.empty())
+			prevLastKey = pending.back().key;
+		pending.clear();
+		pendingKeyBytes = 0;
+	};
+
+	for (std::size_t i = 0; i < numEntries; i++) {
+		RIDKeyPair<T> entry;
+		next(entry);
+		const int keyBytes = LeafNode<T>::keyBytes(entry.key);
+		if (!pending.empty()) {
+			const int prefixLength = LeafNode<T>::sharedPrefix(pending.front().key, entry.key);
+			if (LeafNode<T>::bytesFor(pending.size() + 1, pendingKeyBytes + keyBytes, prefixLength) > leafBudget)
+				flushLeaf();
+		}
+		pending.push_back(entry);
+		pendingKeyBytes += keyBytes;
+	}
+	if (!pending.empty() || level.empty())
+		flushLeaf();
+	this->bufMgr->unPinPage(this->file, prevPageNo, true);
+
+	return packLevels<T>(level, fillFactor);
+}
+
+template <class T>
+PageId BTreeIndex::packLevels(std::vector<PageKeyPair<T> >& level, const double fillFactor)
 {
-  this->scanExecuting = false;
-  this->bufMgr -> flushFile(file);
-  delete file;
+	const double nodeBudget = NonLeafNode<T>::CAPACITY * std::min(fillFactor, 1.0);
+
+	//Build non-leaf levels until a single node is left. The root is a non-leaf even
+	//when there is only one leaf.
+	int nodeLevel = 1;
+	do {
+		std::vector<PageKeyPair<T> > parents;
+
+		std::size_t first = 0;
+		while (first < level.size()) {
+			std::size_t last = first + 1;
+			int keyBytes = 0;
+			while (last < level.size()) {
+				const int bytes = keyBytes + NonLeafNode<T>::keyBytes(level[last].key);
+				if (last - first >= 2 && NonLeafNode<T>::bytesFor(last - first, bytes) > nodeBudget)
+					break;
+				keyBytes = bytes;
+				last++;
+			}
+
+			std::vector<T> keys;
+			std::vector<PageId> children;
+			for (std::size_t i = first; i < last; i++) {
+				if (i > first)
+					keys.push_back(level[i].key);
+				children.push_back(level[i].pageNo);
+			}
+
+			PageId pageNo;
+			Page* page;
+			allocNode(pageNo, page);
+			NonLeafNode<T>* node = (NonLeafNode<T>*)page;
+			node->level = nodeLevel;
+			node->setEntries(keys.empty() ? NULL : &keys[0], &children[0], keys.size());
+			this->bufMgr->unPinPage(this->file, pageNo, true);
+
+			PageKeyPair<T> parent;
+			parent.set(pageNo, level[first].key);
+			parents.push_back(parent);
+			first = last;
+		}
+
+		level.swap(parents);
+		nodeLevel = 0;
+	} while (level.size() > 1);
+
+	return level[0].pageNo;
 }
 
-//TODO
-void BTreeIndex::insertEntry(const void *key, const RecordId rid) 
+// -----------------------------------------------------------------------------
+// Parallel bulk loading
+// -----------------------------------------------------------------------------
+
+// Number of leaves a thread packs before writing them to the index file with a single call.
+static const std::size_t LEAFWRITEBATCH = 64;
+
+// Run work(0) to work(n - 1) on a thread each, and rethrow the first exception any of them threw.
+template <class Work>
+static void runThreads(const unsigned n, Work work)
+{
+	std::vector<std::exception_ptr> errors(n);
+	std::vector<std::thread> threads;
+	for (unsigned i = 0; i < n; i++) {
+		threads.push_back(std::thread([&work, &errors, i]() {
+			try {
+				work(i);
+			} catch (...) {
+				errors[i] = std::current_exception();
+			}
+		}));
+	}
+	for (unsigned i = 0; i < n; i++)
+		threads[i].join();
+	for (unsigned i = 0; i < n; i++) {
+		if (errors[i])
+			std::rethrow_exception(errors[i]);
+	}
+}
+
+template <class T>
+void BTreeIndex::parallelLoad(const std::string& relationName, const double fillFactor, const unsigned numThreads)
+{
+	const unsigned threads = numThreads > 0 ? numThreads : std::max(std::thread::hardware_concurrency(), 1u);
+	const double leafBudget = LeafNode<T>::CAPACITY * std::min(fillFactor, 1.0);
+
+	//Every scan worker collects the keys of the batches it scans into a partition of its own, which
+	//it finds by its thread id once per batch
+	std::vector<std::vector<RIDKeyPair<T> > > partitions(threads);
+	{
+		std::mutex lock;
+		std::map<std::thread::id, std::size_t> partitionOf;
+		ParallelFileScan fscan(relationName, bufMgr, threads);
+		const ScanAttribute key = {this->attrByteOffset, (int)sizeof(T)};
+		fscan.setProjection(std::vector<ScanAttribute>(1, key));
+		fscan.scan([&](const RecordBatch& batch) {
+			std::size_t p;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				p = partitionOf.insert(std::make_pair(std::this_thread::get_id(), partitionOf.size())).first->second;
+			}
+			std::vector<RIDKeyPair<T> >& partition = partitions[p];
+			for (std::size_t i = 0; i < batch.size(); i++) {
+				RIDKeyPair<T> entry;
+				entry.set(batch.getRecordId(i), loadKey<T>(batch.getRecord(i).data()));
+				partition.push_back(entry);
+			}
+		});
+	}
+
+	runThreads(threads, [&](unsigned p) { std::sort(partitions[p].begin(), partitions[p].end()); });
+
+	std::size_t numEntries = 0;
+	std::size_t largest = 0;
+	for (unsigned p = 0; p < threads; p++) {
+		numEntries += partitions[p].size();
+		if (partitions[p].size() > partitions[largest].size())
+			largest = p;
+	}
+	if (numEntries == 0) {
+		//The root still gets a single, empty leaf child
+		std::vector<PageKeyPair<T> > level(1);
+		PageId pageNo;
+		Page* page;
+		allocNode(pageNo, page);
+		((LeafNode<T>*)page)->setEntries(NULL, 0);
+		this->bufMgr->unPinPage(this->file, pageNo, true);
+		level[0].set(pageNo, T());
+		this->rootPageNum = packLevels<T>(level, fillFactor);
+		return;
+	}
+
+	//Split the entries into one slice per thread at evenly spaced entries of the largest partition,
+	//finding in every partition the entries that fall into each slice
+	std::vector<std::vector<std::size_t> > bounds(threads + 1, std::vector<std::size_t>(threads));
+	std::vector<std::size_t> sliceStart(threads + 1, 0);
+	for (unsigned t = 1; t <= threads; t++) {
+		for (unsigned p = 0; p < threads; p++) {
+			const std::vector<RIDKeyPair<T> >& partition = partitions[p];
+			if (t == threads)
+				bounds[t][p] = partition.size();
+			else
+				bounds[t][p] = std::lower_bound(partition.begin(), partition.end(),
+						partitions[largest][partitions[largest].size() * t / threads]) - partition.begin();
+			sliceStart[t] += bounds[t][p];
+		}
+	}
+
+	//Every thread merges the parts of the partitions in its slice, and splits the slice into leaves
+	std::vector<RIDKeyPair<T> > entries(numEntries);
+	std::vector<std::vector<std::size_t> > leafStarts(threads);
+	runThreads(threads, [&](unsigned t) {
+		typedef std::pair<RIDKeyPair<T>, unsigned> HeapItem;
+		struct HeapOrder {
+			bool operator()(const HeapItem& a, const HeapItem& b) const { return b.first < a.first; }
+		};
+		std::priority_queue<HeapItem, std::vector<HeapItem>, HeapOrder> heap;
+		std::vector<std::size_t> next(bounds[t]);
+		for (unsigned p = 0; p < threads; p++) {
+			if (next[p] < bounds[t + 1][p])
+				heap.push(HeapItem(partitions[p][next[p]++], p));
+		}
+		for (std::size_t i = sliceStart[t]; i < sliceStart[t + 1]; i++) {
+			HeapItem item = heap.top();
+			heap.pop();
+			entries[i] = item.first;
+			const unsigned p = item.second;
+			if (next[p] < bounds[t + 1][p]) {
+				item.first = partitions[p][next[p]++];
+				heap.push(item);
+			}
+		}
+
+		//Same rule as packTree(), applied to the slice on its own
+		std::size_t first = sliceStart[t];
+		while (first < sliceStart[t + 1]) {
+			leafStarts[t].push_back(first);
+			int keyBytes = LeafNode<T>::keyBytes(entries[first].key);
+			std::size_t last = first + 1;
+			while (last < sliceStart[t + 1]) {
+				const int bytes = keyBytes + LeafNode<T>::keyBytes(entries[last].key);
+				const int prefixLength = LeafNode<T>::sharedPrefix(entries[first].key, entries[last].key);
+				if (LeafNode<T>::bytesFor(last - first + 1, bytes, prefixLength) > leafBudget)
+					break;
+				keyBytes = bytes;
+				last++;
+			}
+			first = last;
+		}
+	});
+	std::vector<std::vector<RIDKeyPair<T> > >().swap(partitions);
+
+	//The leaves take consecutive pages, so the right sibling of every leaf but the last is the next page
+	std::vector<std::size_t> leafOffset(threads + 1, 0);
+	for (unsigned t = 0; t < threads; t++)
+		leafOffset[t + 1] = leafOffset[t] + leafStarts[t].size();
+	const std::size_t numLeaves = leafOffset[threads];
+	const PageId firstLeafNo = static_cast<BlobFile*>(this->file)->allocatePages(numLeaves);
+
+	std::vector<PageKeyPair<T> > level(numLeaves);
+	runThreads(threads, [&](unsigned t) {
+		std::vector<Page> pages(std::min(LEAFWRITEBATCH, leafStarts[t].size()));
+		std::size_t batchSize = 0;
+		PageId batchPageNo = firstLeafNo + leafOffset[t];
+		for (std::size_t j = 0; j < leafStarts[t].size(); j++) {
+			const std::size_t first = leafStarts[t][j];
+			const std::size_t last = j + 1 < leafStarts[t].size() ? leafStarts[t][j + 1] : sliceStart[t + 1];
+			const std::size_t leafNo = leafOffset[t] + j;
+			const PageId pageNo = firstLeafNo + leafNo;
+
+			Page* page = &pages[batchSize];
+			memset(reinterpret_cast<char*>(page), 0, Page::SIZE);
+			LeafNode<T>* leaf = (LeafNode<T>*)page;
+			leaf->setEntries(&entries[first], last - first);
+			leaf->rightSibPageNo = leafNo + 1 < numLeaves ? pageNo + 1 : Page::INVALID_NUMBER;
+			batchSize++;
+
+			level[leafNo].set(pageNo, first == 0 ? T() : shortestSeparator(entries[first - 1].key, entries[first].key));
+
+			if (batchSize == pages.size() || j + 1 == leafStarts[t].size()) {
+				this->file->writePages(batchPageNo, &pages[0], batchSize);
+				batchPageNo += batchSize;
+				batchSize = 0;
+			}
+		}
+	});
+	std::vector<RIDKeyPair<T> >().swap(entries);
+
+	this->rootPageNum = packLevels<T>(level, fillFactor);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::deleteEntry
+// -----------------------------------------------------------------------------
+
+bool BTreeIndex::deleteEntry(const void *key, const RecordId rid)
+{
+	//The scan could be holding a leaf that is about to be merged away
+	if (this->scanExecuting)
+		endScan();
+
+	switch (this->attributeType) {
+	case INTEGER:
+		return deleteKey<int>(loadKey<int>(key), rid);
+	case DOUBLE:
+		return deleteKey<double>(loadKey<double>(key), rid);
+	case STRING:
+		return deleteKey<StringKey>(loadKey<StringKey>(key), rid);
+	}
+	return false;
+}
+
+template <class T>
+bool BTreeIndex::deleteKey(const T& key, const RecordId rid)
+{
+	RIDKeyPair<T> entry;
+	entry.set(rid, key);
+
+	//The root is allowed to fall below the threshold
+	bool underflow;
+	if (!removeNonLeaf<T>(this->rootPageNum, entry, underflow))
+		return false;
+	shrinkRoot<T>();
+	return true;
+}
+
+template <class T>
+bool BTreeIndex::removeNonLeaf(const PageId pageNo, const RIDKeyPair<T>& entry, bool& underflow)
 {
+	Page* page;
+	this->bufMgr->readPage(this->file, pageNo, page);
+	NonLeafNode<T>* node = (NonLeafNode<T>*)page;
+
+	//Entries with the key may be in any child from the one findLeaf picks up to the one insertion picks
+	const int first = node->lowerBound(entry.key);
+	const int last = node->upperBound(entry.key);
+	std::vector<PageId> children;
+	for (int i = first; i <= last; i++)
+		children.push_back(node->childAt(i));
+	const bool childIsLeaf = node->level == 1;
+	this->bufMgr->unPinPage(this->file, pageNo, false);
+
+	for (int i = first; i <= last; i++) {
+		bool childUnderflow;
+		const bool found = childIsLeaf ?
+			removeLeaf<T>(children[i - first], entry, childUnderflow) :
+			removeNonLeaf<T>(children[i - first], entry, childUnderflow);
+		if (!found)
+			continue;
+
+		if (childUnderflow)
+			rebalance<T>(pageNo, i);
+
+		this->bufMgr->readPage(this->file, pageNo, page);
+		underflow = ((NonLeafNode<T>*)page)->bytesUsed() < this->mergeThreshold * NonLeafNode<T>::CAPACITY;
+		this->bufMgr->unPinPage(this->file, pageNo, false);
+		return true;
+	}
+
+	underflow = false;
+	return false;
+}
+
+template <class T>
+bool BTreeIndex::removeLeaf(const PageId pageNo, const RIDKeyPair<T>& entry, bool& underflow)
+{
+	Page* page;
+	this->bufMgr->readPage(this->file, pageNo, page);
+	LeafNode<T>* leaf = (LeafNode<T>*)page;
+
+	for (int i = leaf->lowerBound(entry.key); leaf->hasEntry(i) && !(entry.key < leaf->keyAt(i)); i++) {
+		if (leaf->ridAt(i) == entry.rid) {
+			leaf->removeAt(i);
+			underflow = leaf->bytesUsed() < this->mergeThreshold * LeafNode<T>::CAPACITY;
+			this->bufMgr->unPinPage(this->file, pageNo, true);
+			return true;
+		}
+	}
+
+	underflow = false;
+	this->bufMgr->unPinPage(this->file, pageNo, false);
+	return false;
+}
+
+template <class T>
+void BTreeIndex::rebalance(const PageId pageNo, const int pos)
+{
+	Page* page;
+	this->bufMgr->readPage(this->file, pageNo, page);
+	NonLeafNode<T>* node = (NonLeafNode<T>*)page;
+
+	//An only child has no sibling to pair with
+	if (node->size() == 0) {
+		this->bufMgr->unPinPage(this->file, pageNo, false);
+		return;
+	}
+
+	//Pair the child with its left sibling, or with its right one if it is the leftmost child
+	const int left = pos > 0 ? pos - 1 : pos;
+	std::vector<T> keys;
+	std::vector<PageId> pages;
+	node->getEntries(keys, pages);
+	const PageId leftPageNo = pages[left];
+	const PageId rightPageNo = pages[left + 1];
+
+	Page* leftPage;
+	Page* rightPage;
+	this->bufMgr->readPage(this->file, leftPageNo, leftPage);
+	this->bufMgr->readPage(this->file, rightPageNo, rightPage);
+
+	bool merged;
+	bool changed = true;
+	if (node->level == 1) {
+		LeafNode<T>* leftLeaf = (LeafNode<T>*)leftPage;
+		LeafNode<T>* rightLeaf = (LeafNode<T>*)rightPage;
+		std::vector<RIDKeyPair<T> > entries;
+		std::vector<RIDKeyPair<T> > rightEntries;
+		leftLeaf->getEntries(entries);
+		rightLeaf->getEntries(rightEntries);
+		entries.insert(entries.end(), rightEntries.begin(), rightEntries.end());
+		const int total = entries.size();
+
+		merged = leafFits(entries, 0, total);
+		if (merged) {
+			leftLeaf->setEntries(total == 0 ? NULL : &entries[0], total);
+			leftLeaf->rightSibPageNo = rightLeaf->rightSibPageNo;
+			keys.erase(keys.begin() + left);
+			pages.erase(pages.begin() + left + 1);
+		} else {
+			//A longer separator might not fit in the parent, in which case the children are left as they are
+			const int mid = leafSplitPoint(entries);
+			keys[left] = shortestSeparator(entries[mid - 1].key, entries[mid].key);
+			changed = nonLeafFits(keys, 0, keys.size());
+			if (changed) {
+				leftLeaf->setEntries(&entries[0], mid);
+				rightLeaf->setEntries(&entries[mid], total - mid);
+			}
+		}
+	} else {
+		//The separator between the two children comes down between their keys
+		NonLeafNode<T>* leftNode = (NonLeafNode<T>*)leftPage;
+		NonLeafNode<T>* rightNode = (NonLeafNode<T>*)rightPage;
+		std::vector<T> childKeys;
+		std::vector<PageId> childPages;
+		std::vector<T> rightKeys;
+		std::vector<PageId> rightPages;
+		leftNode->getEntries(childKeys, childPages);
+		rightNode->getEntries(rightKeys, rightPages);
+		childKeys.push_back(keys[left]);
+		childKeys.insert(childKeys.end(), rightKeys.begin(), rightKeys.end());
+		childPages.insert(childPages.end(), rightPages.begin(), rightPages.end());
+		const int total = childKeys.size();
+
+		merged = nonLeafFits(childKeys, 0, total);
+		if (merged) {
+			leftNode->setEntries(&childKeys[0], &childPages[0], total);
+			keys.erase(keys.begin() + left);
+			pages.erase(pages.begin() + left + 1);
+		} else {
+			const int mid = nonLeafSplitPoint(childKeys);
+			keys[left] = childKeys[mid];
+			changed = nonLeafFits(keys, 0, keys.size());
+			if (changed) {
+				leftNode->setEntries(&childKeys[0], &childPages[0], mid);
+				rightNode->setEntries(&childKeys[mid + 1], &childPages[mid + 1], total - mid - 1);
+			}
+		}
+	}
+
+	if (changed)
+		node->setEntries(keys.empty() ? NULL : &keys[0], &pages[0], keys.size());
+
+	this->bufMgr->unPinPage(this->file, leftPageNo, changed);
+	this->bufMgr->unPinPage(this->file, rightPageNo, changed && !merged);
+	this->bufMgr->unPinPage(this->file, pageNo, changed);
+	if (merged)
+		freeNode(rightPageNo);
+}
+
+template <class T>
+void BTreeIndex::shrinkRoot()
+{
+	while (true) {
+		Page* page;
+		this->bufMgr->readPage(this->file, this->rootPageNum, page);
+		NonLeafNode<T>* root = (NonLeafNode<T>*)page;
+		const bool shrink = root->size() == 0 && root->level == 0;
+		const PageId childPageNo = root->childAt(0);
+		this->bufMgr->unPinPage(this->file, this->rootPageNum, false);
+		if (!shrink)
+			return;
+
+		const PageId oldRootPageNum = this->rootPageNum;
+		this->rootPageNum = childPageNo;
+		freeNode(oldRootPageNum);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::lookup
+// -----------------------------------------------------------------------------
+
+bool BTreeIndex::lookup(const void* key, std::vector<RecordId>& outRids)
+{
+	switch (this->attributeType) {
+	case INTEGER:
+		return lookupOn<int>(loadKey<int>(key), outRids);
+	case DOUBLE:
+		return lookupOn<double>(loadKey<double>(key), outRids);
+	case STRING:
+		return lookupOn<StringKey>(loadKey<StringKey>(key), outRids);
+	}
+	return false;
+}
+
+template <class T>
+bool BTreeIndex::lookupOn(const T& key, std::vector<RecordId>& outRids)
+{
+	const std::size_t found = outRids.size();
+	collectMatches<T>(findLeaf<T>(key), key, outRids);
+	return outRids.size() > found;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::lookupMany
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::lookupMany(const std::vector<const void*>& keys, std::vector<std::vector<RecordId> >& outRids)
+{
+	switch (this->attributeType) {
+	case INTEGER:
+		lookupManyOn<int>(keys, outRids);
+		break;
+	case DOUBLE:
+		lookupManyOn<double>(keys, outRids);
+		break;
+	case STRING:
+		lookupManyOn<StringKey>(keys, outRids);
+		break;
+	}
+}
+
+template <class T>
+void BTreeIndex::lookupManyOn(const std::vector<const void*>& keys, std::vector<std::vector<RecordId> >& outRids)
+{
+	outRids.assign(keys.size(), std::vector<RecordId>());
+	if (keys.empty())
+		return;
+
+	std::vector<std::pair<T, std::size_t> > probes(keys.size());
+	for (std::size_t i = 0; i < keys.size(); i++) {
+		probes[i].first = loadKey<T>(keys[i]);
+		probes[i].second = i;
+	}
+	std::sort(probes.begin(), probes.end(),
+		[](const std::pair<T, std::size_t>& a, const std::pair<T, std::size_t>& b) { return a.first < b.first; });
+
+	//The probes are sorted, so each carries on in the leaf where the previous one stopped, from the
+	//first entry it did not take, and only descends from the root once its key is past the leaf's last key.
+	//Entries of a key that run on into the right siblings leave the walk in the last of them.
+	PageId leafPageNo = Page::INVALID_NUMBER;
+	LeafNode<T>* leaf = NULL;
+	int pos = 0;
+	for (std::size_t i = 0; i < probes.size(); i++) {
+		const T& key = probes[i].first;
+		std::vector<RecordId>& rids = outRids[probes[i].second];
+		if (i > 0 && !(probes[i - 1].first < key)) {
+			//A repeated key has the matches of the previous probe, which the walk has already passed
+			rids = outRids[probes[i - 1].second];
+			continue;
+		}
+
+		if (leaf == NULL || !leaf->hasEntry(0) || leaf->keyAt(leaf->size() - 1) < key) {
+			if (leaf != NULL) {
+				this->bufMgr->unPinPage(this->file, leafPageNo, false);
+				leaf = NULL;
+			}
+			leafPageNo = findLeaf<T>(key);
+			Page* page;
+			this->bufMgr->readPage(this->file, leafPageNo, page);
+			leaf = (LeafNode<T>*)page;
+			pos = 0;
+		}
+
+		while (leaf->hasEntry(pos) && leaf->keyAt(pos) < key)
+			pos++;
+		while (true) {
+			for (; leaf->hasEntry(pos) && !(key < leaf->keyAt(pos)); pos++)
+				rids.push_back(leaf->ridAt(pos));
+			if (leaf->hasEntry(pos) || leaf->rightSibPageNo == Page::INVALID_NUMBER)
+				break;
+
+			const PageId sibPageNo = leaf->rightSibPageNo;
+			this->bufMgr->unPinPage(this->file, leafPageNo, false);
+			leaf = NULL;
+			Page* page;
+			this->bufMgr->readPage(this->file, sibPageNo, page);
+			leafPageNo = sibPageNo;
+			leaf = (LeafNode<T>*)page;
+			pos = 0;
+		}
+	}
+	if (leaf != NULL)
+		this->bufMgr->unPinPage(this->file, leafPageNo, false);
+}
+
+// Append the rids of the entries of the leaf with the given key. Returns true
+// if the leaf ran out before a greater key was found, in which case more may
+// follow in the right sibling.
+template <class T>
+static bool appendMatches(const LeafNode<T>* leaf, const T& key, std::vector<RecordId>& outRids)
+{
+	for (int i = leaf->lowerBound(key); leaf->hasEntry(i); i++) {
+		if (key < leaf->keyAt(i))
+			return false;
+		outRids.push_back(leaf->ridAt(i));
+	}
+	return true;
+}
+
+template <class T>
+void BTreeIndex::collectMatches(PageId pageNo, const T& key, std::vector<RecordId>& outRids)
+{
+	while (pageNo != Page::INVALID_NUMBER) {
+		Page* page;
+		this->bufMgr->readPage(this->file, pageNo, page);
+		LeafNode<T>* leaf = (LeafNode<T>*)page;
+		const bool more = appendMatches(leaf, key, outRids);
+		const PageId sibPageNo = leaf->rightSibPageNo;
+		this->bufMgr->unPinPage(this->file, pageNo, false);
+
+		if (!more)
+			return;
+		pageNo = sibPageNo;
+	}
 }
 
+// -----------------------------------------------------------------------------
+// BTreeIndex::startScan
+// -----------------------------------------------------------------------------
+
 void BTreeIndex::startScan(const void* lowValParm,
 				   const Operator lowOpParm,
 				   const void* highValParm,
 				   const Operator highOpParm)
 {
-  if (scanExecuting) {
+	if (this->scanExecuting) {
 		endScan();
-  }
-  if (lowOpParm!=GT && lowOpParm != GTE && highOpParm != LT && highOpParm != LTE) {
-    throw BadOpcodesException();
-  }
-  if(lowValInt > highValInt) {
-    throw BadScanrangeException();
-  }
-
-  this->scanExecuting = true;
-  this->lowValInt = *(int*)lowValParm;
-  this->highValInt = *(int*)highValParm;
-  this->lowOp = lowOpParm;
-  this->highOp = highOpParm;
-  //call to getNextEntry, had that function been implemented
-  //this->nextEntry = getNextEntry(this->rootPageNum);
+	}
+	if ((lowOpParm != GT && lowOpParm != GTE) || (highOpParm != LT && highOpParm != LTE)) {
+		throw BadOpcodesException();
+	}
+
+	switch (this->attributeType) {
+	case INTEGER:
+		startScanOn<int>(lowValParm, lowOpParm, highValParm, highOpParm);
+		break;
+	case DOUBLE:
+		startScanOn<double>(lowValParm, lowOpParm, highValParm, highOpParm);
+		break;
+	case STRING:
+		startScanOn<StringKey>(lowValParm, lowOpParm, highValParm, highOpParm);
+		break;
+	}
 }
 
+template <class T>
+void BTreeIndex::startScanOn(const void* lowValParm,
+				   const Operator lowOpParm,
+				   const void* highValParm,
+				   const Operator highOpParm)
+{
+	const T low = loadKey<T>(lowValParm);
+	const T high = loadKey<T>(highValParm);
+	if (high < low) {
+		throw BadScanrangeException();
+	}
+
+	lowVal<T>() = low;
+	highVal<T>() = high;
+	this->lowOp = lowOpParm;
+	this->highOp = highOpParm;
+
+	//Pin the leftmost leaf that may hold the low value and skip to the first entry that satisfies it
+	this->currentPageNum = findLeaf<T>(low);
+	this->bufMgr->readPage(this->file, this->currentPageNum, this->currentPageData);
+	prefetchNextLeaf<T>();
+	this->nextEntry = 0;
+	this->scanExecuting = true;
+
+	//Duplicates of the low value may run past the end of the leaf, in which case the first
+	//qualifying entry is further along the chain
+	while (true) {
+		if (!nextLeafEntry<T>()) {
+			this->scanExecuting = false;
+			throw NoSuchKeyFoundException();
+		}
+		LeafNode<T>* leaf = (LeafNode<T>*)this->currentPageData;
+		this->nextEntry = this->lowOp == GT ? leaf->upperBound(low) : leaf->lowerBound(low);
+		if (leaf->hasEntry(this->nextEntry))
+			break;
+	}
+
+	if (!satisfiesHigh<T>(((LeafNode<T>*)this->currentPageData)->keyAt(this->nextEntry))) {
+		endScan();
+		throw NoSuchKeyFoundException();
+	}
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::scanNext
+// -----------------------------------------------------------------------------
+
 void BTreeIndex::scanNext(RecordId& outRid) 
 {
+	if (!this->scanExecuting) {
+		throw ScanNotInitializedException();
+	}
+
+	switch (this->attributeType) {
+	case INTEGER:
+		scanNextOn<int>(outRid);
+		break;
+	case DOUBLE:
+		scanNextOn<double>(outRid);
+		break;
+	case STRING:
+		scanNextOn<StringKey>(outRid);
+		break;
+	}
+}
+
+template <class T>
+void BTreeIndex::scanNextOn(RecordId& outRid)
+{
+	if (!nextLeafEntry<T>()) {
+		throw IndexScanCompletedException();
+	}
+
+	LeafNode<T>* leaf = (LeafNode<T>*)this->currentPageData;
+	if (!satisfiesHigh<T>(leaf->keyAt(this->nextEntry))) {
+		throw IndexScanCompletedException();
+	}
+	outRid = leaf->ridAt(this->nextEntry);
+	this->nextEntry++;
+}
+
+template <class T>
+PageId BTreeIndex::findLeaf(const T& key)
+{
+	PageId pageNo = this->rootPageNum;
+	while (true) {
+		Page* page;
+		this->bufMgr->readPage(this->file, pageNo, page);
+		NonLeafNode<T>* node = (NonLeafNode<T>*)page;
+
+		//Equal keys may have spilled into the child left of a matching separator
+		const int pos = node->lowerBound(key);
+		const PageId childPageNo = node->childAt(pos);
+		const bool childIsLeaf = node->level == 1;
+		this->bufMgr->unPinPage(this->file, pageNo, false);
+
+		if (childIsLeaf)
+			return childPageNo;
+		pageNo = childPageNo;
+	}
 }
 
+template <class T>
+bool BTreeIndex::nextLeafEntry()
+{
+	if (this->currentPageNum == Page::INVALID_NUMBER)
+		return false;
+
+	LeafNode<T>* leaf = (LeafNode<T>*)this->currentPageData;
+	while (!leaf->hasEntry(this->nextEntry)) {
+		const PageId sibPageNo = leaf->rightSibPageNo;
+		this->bufMgr->unPinPage(this->file, this->currentPageNum, false);
+		this->currentPageNum = sibPageNo;
+		this->currentPageData = NULL;
+		this->nextEntry = 0;
+		if (sibPageNo == Page::INVALID_NUMBER)
+			return false;
+
+		this->bufMgr->readPage(this->file, this->currentPageNum, this->currentPageData);
+		leaf = (LeafNode<T>*)this->currentPageData;
+		prefetchNextLeaf<T>();
+	}
+	return true;
+}
+
+template <class T>
+void BTreeIndex::prefetchNextLeaf()
+{
+	//The sibling is only needed if every key of this leaf is within the high bound
+	LeafNode<T>* leaf = (LeafNode<T>*)this->currentPageData;
+	const int size = leaf->size();
+	if (size > 0 && !satisfiesHigh<T>(leaf->keyAt(size - 1)))
+		return;
+	this->bufMgr->prefetchPage(this->file, leaf->rightSibPageNo);
+}
+
+template <class T>
+bool BTreeIndex::satisfiesHigh(const T& key)
+{
+	return this->highOp == LT ? key < highVal<T>() : key <= highVal<T>();
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::endScan
+// -----------------------------------------------------------------------------
+
 void BTreeIndex::endScan() 
 {
-	if (!this->scanExecuting){
+	if (!this->scanExecuting) {
 		throw ScanNotInitializedException();
-  	}
-	try {
+	}
+	//The scan may already have run off the end of the leaf chain, leaving nothing pinned
+	if (this->currentPageNum != Page::INVALID_NUMBER) {
 		this->bufMgr->unPinPage(this->file, this->currentPageNum, false);
-	} catch(PageNotPinnedException& e){ }
+	}
+	this->currentPageNum = Page::INVALID_NUMBER;
+	this->currentPageData = NULL;
 	this->scanExecuting = false;
 }
-}
\ No newline at end of file
+
+}
@@ -8,7 +8,9 @@
 #pragma once
 
 #include <iostream>
+#include <cstdint>
 #include <string>
+#include <vector>
 #include "string.h"
 #include <sstream>
 
@@ -21,26 +23,20 @@ namespace badgerdb
 {
 
 /**
- * @brief Datatype enumeration type.
+ * @brief How a new index is populated from its base relation. Passed to the BTreeIndex constructor.
  */
-enum Datatype
+enum BuildMode
 {
-	INTEGER = 0,
-	DOUBLE = 1,
-	STRING = 2
+	INSERT_BUILD,	/* Insert the tuples one at a time from the root */
+	BULK_BUILD,		/* Sort all entries and pack the tree bottom-up */
+	PARALLEL_BUILD	/* Bulk load with several threads scanning, sorting and writing the leaves */
 };
 
+
 /**
- * @brief Scan operations enumeration. Passed to BTreeIndex::startScan() method.
+ * @brief Size of String key.
  */
-enum Operator
-{ 
-	LT, 	/* Less Than */
-	LTE,	/* Less Than or Equal to */
-	GTE,	/* Greater Than or Equal to */
-	GT		/* Greater Than */
-};
-
+const  int STRINGSIZE = 64;
 
 /**
  * @brief Number of key slots in B+Tree leaf for INTEGER key.
@@ -48,12 +44,147 @@ enum Operator
 //                                                  sibling ptr             key               rid
 const  int INTARRAYLEAFSIZE = ( Page::SIZE - sizeof( PageId ) ) / ( sizeof( int ) + sizeof( RecordId ) );
 
+/**
+ * @brief Number of key slots in B+Tree leaf for DOUBLE key.
+ */
+//                                                     sibling ptr               key               rid
+const  int DOUBLEARRAYLEAFSIZE = ( Page::SIZE - sizeof( PageId ) ) / ( sizeof( double ) + sizeof( RecordId ) );
+
+/**
+ * @brief Bytes of a STRING leaf holding its slot directory and key suffixes.
+ */
+//                                             sibling ptr      numKeys, prefixLength, heapOffset       prefix
+const  int STRINGLEAFDATASIZE = Page::SIZE - sizeof( PageId ) - 3 * sizeof( std::uint16_t ) - STRINGSIZE;
+
+/**
+ * @brief Size of a slot of a STRING leaf: rid page number and slot number, suffix offset and suffix length.
+ */
+const  int STRINGLEAFSLOTSIZE = sizeof( PageId ) + sizeof( SlotId ) + sizeof( std::uint16_t ) + sizeof( std::uint8_t );
+
+/**
+ * @brief Maximum number of entries in B+Tree leaf for STRING key, reached when every key equals the page prefix.
+ */
+const  int STRINGARRAYLEAFSIZE = STRINGLEAFDATASIZE / STRINGLEAFSLOTSIZE;
+
 /**
  * @brief Number of key slots in B+Tree non-leaf for INTEGER key.
  */
 //                                                     level     extra pageNo                  key       pageNo
 const  int INTARRAYNONLEAFSIZE = ( Page::SIZE - sizeof( int ) - sizeof( PageId ) ) / ( sizeof( int ) + sizeof( PageId ) );
 
+/**
+ * @brief Number of key slots in B+Tree non-leaf for DOUBLE key.
+ */
+//                                                     level (padded to key alignment)   extra pageNo          key            pageNo
+const  int DOUBLEARRAYNONLEAFSIZE = ( Page::SIZE - sizeof( double ) - sizeof( PageId ) ) / ( sizeof( double ) + sizeof( PageId ) );
+
+/**
+ * @brief Bytes of a STRING non-leaf holding its slot directory and separators.
+ */
+//                                                level         numKeys, heapOffset        first pageNo
+const  int STRINGNONLEAFDATASIZE = Page::SIZE - sizeof( int ) - 2 * sizeof( std::uint16_t ) - sizeof( PageId );
+
+/**
+ * @brief Size of a slot of a STRING non-leaf: page number right of the separator, separator offset and length.
+ */
+const  int STRINGNONLEAFSLOTSIZE = sizeof( PageId ) + sizeof( std::uint16_t ) + sizeof( std::uint8_t );
+
+/**
+ * @brief Maximum number of keys in B+Tree non-leaf for STRING key.
+ */
+const  int STRINGARRAYNONLEAFSIZE = STRINGNONLEAFDATASIZE / STRINGNONLEAFSLOTSIZE;
+
+/**
+ * @brief Key type of a STRING index. Holds the first STRINGSIZE characters of the string, padded with
+ * NUL bytes, so that two keys compare byte by byte the same way as the strings they hold.
+ */
+struct StringKey {
+	char data[ STRINGSIZE ];
+};
+
+inline bool operator<( const StringKey& k1, const StringKey& k2 ) { return memcmp( k1.data, k2.data, STRINGSIZE ) < 0; }
+inline bool operator<=( const StringKey& k1, const StringKey& k2 ) { return memcmp( k1.data, k2.data, STRINGSIZE ) <= 0; }
+inline bool operator>( const StringKey& k1, const StringKey& k2 ) { return memcmp( k1.data, k2.data, STRINGSIZE ) > 0; }
+inline bool operator==( const StringKey& k1, const StringKey& k2 ) { return memcmp( k1.data, k2.data, STRINGSIZE ) == 0; }
+inline bool operator!=( const StringKey& k1, const StringKey& k2 ) { return memcmp( k1.data, k2.data, STRINGSIZE ) != 0; }
+
+/**
+ * @brief Per key type properties of the B+Tree nodes. Specialized for int, double and StringKey, the
+ * key types of INTEGER, DOUBLE and STRING indexes.
+ */
+template <class T>
+struct KeyTraits;
+
+template <>
+struct KeyTraits<int> {
+	static const int LEAFSIZE = INTARRAYLEAFSIZE;
+	static const int NONLEAFSIZE = INTARRAYNONLEAFSIZE;
+};
+
+template <>
+struct KeyTraits<double> {
+	static const int LEAFSIZE = DOUBLEARRAYLEAFSIZE;
+	static const int NONLEAFSIZE = DOUBLEARRAYNONLEAFSIZE;
+};
+
+template <>
+struct KeyTraits<StringKey> {
+	static const int LEAFSIZE = STRINGARRAYLEAFSIZE;
+	static const int NONLEAFSIZE = STRINGARRAYNONLEAFSIZE;
+};
+
+/**
+ * @brief Index of the first of the n sorted keys that is not less than key. The range is halved with a
+ * conditional move instead of a branch, so the number of iterations only depends on n and a full node
+ * costs no mispredictions.
+ */
+template <class T>
+int lowerBound(const T* keys, int n, const T& key)
+{
+	if (n == 0)
+		return 0;
+	const T* base = keys;
+	while (n > 1) {
+		const int half = n / 2;
+		base = (base[half] < key) ? base + half : base;
+		n -= half;
+	}
+	return (base - keys) + (*base < key);
+}
+
+/**
+ * @brief Index of the first of the n sorted keys that is greater than key.
+ * @see lowerBound()
+ */
+template <class T>
+int upperBound(const T* keys, int n, const T& key)
+{
+	if (n == 0)
+		return 0;
+	const T* base = keys;
+	while (n > 1) {
+		const int half = n / 2;
+		base = (base[half] <= key) ? base + half : base;
+		n -= half;
+	}
+	return (base - keys) + (*base <= key);
+}
+
+/**
+ * @brief Number of key-rid pairs the bulk loader sorts in memory before spilling a sorted run to disk.
+ */
+const  int BULKLOADRUNSIZE = 1 << 20;
+
+/**
+ * @brief Default fraction of the space of each node filled by the bulk loader.
+ */
+const  double DEFAULTFILLFACTOR = 1.0;
+
+/**
+ * @brief Default fraction of the space of a node below which a deletion rebalances it with a sibling.
+ */
+const  double DEFAULTMERGETHRESHOLD = 0.5;
+
 /**
  * @brief Structure to store a key-rid pair. It is used to pass the pair to functions that 
  * add to or make changes to the leaf node pages of the tree. Is templated for the key member.
@@ -128,6 +259,11 @@ struct IndexMetaInfo{
    * Page number of root page of the B+ Tree inside the file index file.
    */
 	PageId rootPageNo;
+
+  /**
+   * Page number of the first page freed by deletions. Free pages are linked through their first PageId.
+   */
+	PageId freePageNo;
 };
 
 /*
@@ -138,9 +274,12 @@ at this level are just above the leaf nodes. Otherwise set to 0.
 */
 
 /**
- * @brief Structure for all non-leaf nodes when the key is of INTEGER type.
+ * @brief Structure for all non-leaf nodes, for keys of type T.
+ * Child i holds the keys in [keyAt(i-1), keyAt(i)). The tree code only goes through the member
+ * functions, so that STRING nodes can use the variable length layout below.
 */
-struct NonLeafNodeInt{
+template <class T>
+struct NonLeafNode{
   /**
    * Level of the node in the tree.
    */
@@ -149,36 +288,233 @@ struct NonLeafNodeInt{
   /**
    * Stores keys.
    */
-	int keyArray[ INTARRAYNONLEAFSIZE ];
+	T keyArray[ KeyTraits<T>::NONLEAFSIZE ];
 
   /**
    * Stores page numbers of child pages which themselves are other non-leaf/leaf nodes in the tree.
    */
-	PageId pageNoArray[ INTARRAYNONLEAFSIZE + 1 ];
+	PageId pageNoArray[ KeyTraits<T>::NONLEAFSIZE + 1 ];
+
+  /**
+   * Bytes available to the keys and child page numbers.
+   */
+	static const int CAPACITY = KeyTraits<T>::NONLEAFSIZE * ( sizeof( T ) + sizeof( PageId ) );
+
+	int size() const;
+	T keyAt(const int i) const;
+	PageId childAt(const int i) const;
+
+  /**
+   * Index of the first key not less than (lowerBound) or greater than (upperBound) key.
+   */
+	int lowerBound(const T& key) const;
+	int upperBound(const T& key) const;
+
+  /**
+   * Insert child.key at index pos and child.pageNo right of it.
+   * @return	False, leaving the node unchanged, if there is no room for them
+   */
+	bool insertAt(const int pos, const PageKeyPair<T>& child);
+
+  /**
+   * Copy out all keys and child page numbers, or replace them with numKeys keys and numKeys+1 children.
+   */
+	void getEntries(std::vector<T>& keys, std::vector<PageId>& children) const;
+	void setEntries(const T* keys, const PageId* children, const int numKeys);
+
+  /**
+   * Bytes taken by a key, and by numKeys keys taking keyBytes bytes together with their children.
+   */
+	static int keyBytes(const T& key);
+	static int bytesFor(const int numKeys, const int keyBytes);
+
+  /**
+   * Bytes taken by the keys and child page numbers now in the node.
+   */
+	int bytesUsed() const;
 };
 
 
 /**
- * @brief Structure for all leaf nodes when the key is of INTEGER type.
+ * @brief Structure for all leaf nodes, for keys of type T.
+ * Like NonLeafNode, it is only accessed through its member functions.
 */
-struct LeafNodeInt{
+template <class T>
+struct LeafNode{
   /**
    * Stores keys.
    */
-	int keyArray[ INTARRAYLEAFSIZE ];
+	T keyArray[ KeyTraits<T>::LEAFSIZE ];
 
   /**
    * Stores RecordIds.
    */
-	RecordId ridArray[ INTARRAYLEAFSIZE ];
+	RecordId ridArray[ KeyTraits<T>::LEAFSIZE ];
 
   /**
    * Page number of the leaf on the right side.
 	 * This linking of leaves allows to easily move from one leaf to the next leaf during index scan.
    */
 	PageId rightSibPageNo;
+
+  /**
+   * Bytes available to the entries.
+   */
+	static const int CAPACITY = KeyTraits<T>::LEAFSIZE * ( sizeof( T ) + sizeof( RecordId ) );
+
+	int size() const;
+	bool hasEntry(const int i) const;
+	T keyAt(const int i) const;
+	RecordId ridAt(const int i) const;
+
+  /**
+   * Index of the first entry whose key is not less than (lowerBound) or greater than (upperBound) key.
+   */
+	int lowerBound(const T& key) const;
+	int upperBound(const T& key) const;
+
+  /**
+   * Insert the entry at index pos.
+   * @return	False, leaving the leaf unchanged, if there is no room for it
+   */
+	bool insertAt(const int pos, const RIDKeyPair<T>& entry);
+
+  /**
+   * Remove the entry at index pos.
+   */
+	void removeAt(const int pos);
+
+  /**
+   * Copy out all entries, or replace them with the count given ones. The sibling link is kept.
+   */
+	void getEntries(std::vector<RIDKeyPair<T> >& entries) const;
+	void setEntries(const RIDKeyPair<T>* entries, const int count);
+
+  /**
+   * Bytes taken by a key, length of the prefix shared by two keys, and bytes taken by count sorted
+   * entries whose keys take keyBytes bytes together and share prefixLength bytes.
+   */
+	static int keyBytes(const T& key);
+	static int sharedPrefix(const T& k1, const T& k2);
+	static int bytesFor(const int count, const int keyBytes, const int prefixLength);
+
+  /**
+   * Bytes taken by the entries now in the leaf.
+   */
+	int bytesUsed() const;
+};
+
+
+/**
+ * @brief Non-leaf node for STRING keys. Separators are cut down to the shortest prefix that tells
+ * the two children apart and stored without padding. Slot i, in the directory at the front of data,
+ * holds the page number of child i+1 and the offset and length of separator i, which are stored
+ * from the end of data downwards.
+*/
+template <>
+struct NonLeafNode<StringKey>{
+	int level;
+
+  /**
+   * Number of separators.
+   */
+	std::uint16_t numKeys;
+
+  /**
+   * Offset in data of the lowest separator byte.
+   */
+	std::uint16_t heapOffset;
+
+  /**
+   * Page number of the leftmost child.
+   */
+	PageId firstPageNo;
+
+	char data[ STRINGNONLEAFDATASIZE ];
+
+	static const int CAPACITY = STRINGNONLEAFDATASIZE;
+
+	int size() const;
+	StringKey keyAt(const int i) const;
+	PageId childAt(const int i) const;
+	int lowerBound(const StringKey& key) const;
+	int upperBound(const StringKey& key) const;
+	bool insertAt(const int pos, const PageKeyPair<StringKey>& child);
+	void getEntries(std::vector<StringKey>& keys, std::vector<PageId>& children) const;
+	void setEntries(const StringKey* keys, const PageId* children, const int numKeys);
+	static int keyBytes(const StringKey& key);
+	static int bytesFor(const int numKeys, const int keyBytes);
+	int bytesUsed() const;
+
+ private:
+	int compareKey(const int i, const StringKey& key) const;
+};
+
+
+/**
+ * @brief Leaf node for STRING keys. The prefix shared by all keys of the leaf is stored once and
+ * only the rest of each key, without padding, is stored from the end of data downwards. Slot i, in
+ * the directory at the front of data, holds the rid of entry i and the offset and length of its suffix.
+*/
+template <>
+struct LeafNode<StringKey>{
+	PageId rightSibPageNo;
+
+  /**
+   * Number of entries.
+   */
+	std::uint16_t numKeys;
+
+  /**
+   * Length of the shared prefix.
+   */
+	std::uint16_t prefixLength;
+
+  /**
+   * Offset in data of the lowest suffix byte.
+   */
+	std::uint16_t heapOffset;
+
+	char prefix[ STRINGSIZE ];
+
+	char data[ STRINGLEAFDATASIZE ];
+
+	static const int CAPACITY = STRINGLEAFDATASIZE;
+
+	int size() const;
+	bool hasEntry(const int i) const;
+	StringKey keyAt(const int i) const;
+	RecordId ridAt(const int i) const;
+	int lowerBound(const StringKey& key) const;
+	int upperBound(const StringKey& key) const;
+	bool insertAt(const int pos, const RIDKeyPair<StringKey>& entry);
+	void removeAt(const int pos);
+	void getEntries(std::vector<RIDKeyPair<StringKey> >& entries) const;
+	void setEntries(const RIDKeyPair<StringKey>* entries, const int count);
+	static int keyBytes(const StringKey& key);
+	static int sharedPrefix(const StringKey& k1, const StringKey& k2);
+	static int bytesFor(const int count, const int keyBytes, const int prefixLength);
+	int bytesUsed() const;
+
+ private:
+	int compareSuffix(const int i, const StringKey& key) const;
+	bool insertSuffix(const int pos, const RIDKeyPair<StringKey>& entry);
 };
 
+typedef NonLeafNode<int> NonLeafNodeInt;
+typedef NonLeafNode<double> NonLeafNodeDouble;
+typedef NonLeafNode<StringKey> NonLeafNodeString;
+typedef LeafNode<int> LeafNodeInt;
+typedef LeafNode<double> LeafNodeDouble;
+typedef LeafNode<StringKey> LeafNodeString;
+
+static_assert(sizeof(NonLeafNodeInt) <= Page::SIZE && sizeof(LeafNodeInt) <= Page::SIZE,
+              "INTEGER nodes must fit in a page.");
+static_assert(sizeof(NonLeafNodeDouble) <= Page::SIZE && sizeof(LeafNodeDouble) <= Page::SIZE,
+              "DOUBLE nodes must fit in a page.");
+static_assert(sizeof(NonLeafNodeString) <= Page::SIZE && sizeof(LeafNodeString) <= Page::SIZE,
+              "STRING nodes must fit in a page.");
+
 
 /**
  * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute of a
@@ -208,6 +544,11 @@ class BTreeIndex {
    */
 	PageId	rootPageNum;
 
+  /**
+   * Page number of the first page of the free page list of the index file.
+   */
+	PageId	freePageNum;
+
   /**
    * Datatype of attribute over which index is built.
    */
@@ -228,6 +569,11 @@ class BTreeIndex {
    */
 	int			nodeOccupancy;
 
+  /**
+   * Fraction of the space of a node below which a deletion rebalances it with a sibling.
+   */
+	double	mergeThreshold;
+
 
 	// MEMBERS SPECIFIC TO SCANNING
 
@@ -264,7 +610,7 @@ class BTreeIndex {
   /**
    * Low STRING value for scan.
    */
-	std::string	lowValString;
+	StringKey	lowValString;
 
   /**
    * High INTEGER value for scan.
@@ -279,7 +625,7 @@ class BTreeIndex {
   /**
    * High STRING value for scan.
    */
-	std::string highValString;
+	StringKey	highValString;
 	
   /**
    * Low Operator. Can only be GT(>) or GTE(>=).
@@ -291,23 +637,294 @@ class BTreeIndex {
    */
 	Operator	highOp;
 
-	
+
+	// HELPERS FOR INSERTION
+	// The key type is chosen once from attributeType by the public methods, which then run the
+	// helpers below instantiated for int, double or StringKey.
+
+  /**
+   * Allocate a new, zeroed page in the index file for use as a tree node, reusing a freed page if
+   * there is one. The page is left pinned.
+   *
+   * @param pageNo	Page number of the newly allocated node returned in this
+   * @param page		Pointer to the pinned page returned in this
+   */
+	void allocNode(PageId& pageNo, Page*& page);
+
+  /**
+   * Put an unpinned node page on the free page list.
+   *
+   * @param pageNo	Page number of the node
+   */
+	void freeNode(const PageId pageNo);
+
+  /**
+   * Write rootPageNum and freePageNum to the meta page.
+   */
+	void updateMeta();
+
+  /**
+   * Populate a newly created index file from every tuple in the base relation.
+   * Sets rootPageNum and the root page number in the meta page.
+   *
+   * @param relationName	Name of the base relation
+   * @param indexName			Name of the index file
+   * @param buildMode			How the index is populated
+   * @param fillFactor		Fraction of the space of every node to fill when bulk loading
+   * @param numThreads		Number of threads of a parallel build, 0 for one per hardware thread
+   */
+	template <class T>
+	void build(const std::string& relationName, const std::string& indexName,
+			const BuildMode buildMode, const double fillFactor, const unsigned numThreads);
+
+  /**
+   * Insert the pair <key,rid>, splitting nodes up to the root as needed.
+   *
+   * @param key	Key to insert
+   * @param rid	Record ID of a record whose entry is getting inserted into the index.
+   */
+	template <class T>
+	void insertKey(const T& key, const RecordId rid);
+
+  /**
+   * Insert the entry into the subtree rooted at the given non-leaf node.
+   * If the node has to be split, the key and page number of the new right sibling are returned
+   * through newChild so that the caller can add them to the parent.
+   *
+   * @param pageNo		Page number of the non-leaf node
+   * @param entry			Key-rid pair to insert
+   * @param newChild	Separator key and page number of the new sibling, set only if split is true
+   * @return					True if the node was split
+   */
+	template <class T>
+	bool insertNonLeaf(const PageId pageNo, const RIDKeyPair<T>& entry, PageKeyPair<T>& newChild);
+
+  /**
+   * Insert the entry into the given leaf node, splitting it if it is full.
+   *
+   * @param pageNo		Page number of the leaf node
+   * @param entry			Key-rid pair to insert
+   * @param newChild	Separator key and page number of the new sibling, set only if split is true
+   * @return					True if the leaf was split
+   */
+	template <class T>
+	bool insertLeaf(const PageId pageNo, const RIDKeyPair<T>& entry, PageKeyPair<T>& newChild);
+
+  /**
+   * Replace the root with a new non-leaf node whose two children are the old root and its new sibling.
+   * Updates rootPageNum and the meta page.
+   *
+   * @param newChild	Separator key and page number of the sibling produced by splitting the root
+   */
+	template <class T>
+	void growRoot(const PageKeyPair<T>& newChild);
+
+
+	// HELPERS FOR BULK LOADING
+
+  /**
+   * Build the tree bottom-up from every tuple in the base relation. The entries are sorted, spilling
+   * sorted runs to a temporary file when there are more than BULKLOADRUNSIZE of them, and then packed
+   * into consecutively allocated leaves before the non-leaf levels are built over them.
+   * Sets rootPageNum but does not update the meta page.
+   *
+   * @param relationName	Name of the base relation
+   * @param indexName			Name of the index file, used to name the temporary run file
+   * @param fillFactor		Fraction of the space of every node to fill
+   */
+	template <class T>
+	void bulkLoad(const std::string& relationName, const std::string& indexName, const double fillFactor);
+
+  /**
+   * Pack a sorted, already counted, sequence of entries into leaves and build the levels above them.
+   *
+   * @param next				Returns the next entry of the sequence in sorted order
+   * @param numEntries	Number of entries in the sequence
+   * @param fillFactor	Fraction of the space of every node to fill
+   * @return						Page number of the new root
+   */
+	template <class T, class NextEntry>
+	PageId packTree(NextEntry next, const std::size_t numEntries, const double fillFactor);
+
+  /**
+   * Build the tree bottom-up like bulkLoad(), with several threads. The relation is scanned by a
+   * ParallelFileScan, each thread sorts the entries it collected, and the sorted partitions are merged
+   * pairwise in parallel. The sorted entries are then split into one slice per thread, and each thread
+   * packs its slice into leaves written straight to a range of pages allocated for all of them up front,
+   * linked to their right siblings. Every entry is held in memory, without spilling sorted runs.
+   * Sets rootPageNum but does not update the meta page.
+   *
+   * @param relationName	Name of the base relation
+   * @param fillFactor		Fraction of the space of every node to fill
+   * @param numThreads		Number of threads, 0 for one per hardware thread
+   */
+	template <class T>
+	void parallelLoad(const std::string& relationName, const double fillFactor, const unsigned numThreads);
+
+  /**
+   * Build the non-leaf levels over a level of nodes until a single node is left, which becomes the root.
+   * The root is a non-leaf even when there is only one leaf.
+   *
+   * @param level				Separator left of and page number of every leaf, in order
+   * @param fillFactor	Fraction of the space of every node to fill
+   * @return						Page number of the new root
+   */
+	template <class T>
+	PageId packLevels(std::vector<PageKeyPair<T> >& level, const double fillFactor);
+
+
+	// HELPERS FOR DELETION
+
+  /**
+   * Remove the entry <key,rid>, rebalancing nodes that fall below mergeThreshold.
+   * @see deleteEntry()
+   */
+	template <class T>
+	bool deleteKey(const T& key, const RecordId rid);
+
+  /**
+   * Remove the entry from the subtree rooted at the given non-leaf node.
+   *
+   * @param pageNo		Page number of the non-leaf node
+   * @param entry			Key-rid pair to remove
+   * @param underflow	Set to true if the node was left below mergeThreshold
+   * @return					True if the entry was found
+   */
+	template <class T>
+	bool removeNonLeaf(const PageId pageNo, const RIDKeyPair<T>& entry, bool& underflow);
+
+  /**
+   * Remove the entry from the given leaf node.
+   * @see removeNonLeaf()
+   */
+	template <class T>
+	bool removeLeaf(const PageId pageNo, const RIDKeyPair<T>& entry, bool& underflow);
+
+  /**
+   * Merge the child at index pos of the given non-leaf node with a sibling, or move entries
+   * between them if they do not fit in one node, updating the separators of the parent.
+   *
+   * @param pageNo	Page number of the parent
+   * @param pos			Index of the child that fell below mergeThreshold
+   */
+	template <class T>
+	void rebalance(const PageId pageNo, const int pos);
+
+  /**
+   * While the root has a single non-leaf child, make that child the root.
+   */
+	template <class T>
+	void shrinkRoot();
+
+
+	// HELPERS FOR LOOKUP
+
+  /**
+   * Find all entries with the given key.
+   * @see lookup()
+   */
+	template <class T>
+	bool lookupOn(const T& key, std::vector<RecordId>& outRids);
+
+  /**
+   * Find all entries for each of a batch of keys.
+   * @see lookupMany()
+   */
+	template <class T>
+	void lookupManyOn(const std::vector<const void*>& keys, std::vector<std::vector<RecordId> >& outRids);
+
+  /**
+   * Append the record ids of the entries with the given key, starting at the given leaf and
+   * following right sibling links while they may hold more. No pages are left pinned.
+   *
+   * @param pageNo	Page number of the first leaf to search
+   * @param key			Key to search for
+   * @param outRids	Record ids of the matching entries are appended to this
+   */
+	template <class T>
+	void collectMatches(PageId pageNo, const T& key, std::vector<RecordId>& outRids);
+
+
+	// HELPERS FOR SCANNING
+
+  /**
+   * Low and high values of the current scan for keys of type T.
+   */
+	template <class T>
+	T& lowVal();
+
+	template <class T>
+	T& highVal();
+
+  /**
+   * Set up the scan and position it on the first matching entry.
+   * @see startScan()
+   */
+	template <class T>
+	void startScanOn(const void* lowValParm, const Operator lowOpParm, const void* highValParm, const Operator highOpParm);
+
+  /**
+   * Fetch the record id of the next matching entry.
+   * @see scanNext()
+   */
+	template <class T>
+	void scanNextOn(RecordId& outRid);
+
+  /**
+   * Descend from the root to the leftmost leaf that may contain the given key.
+   * No pages are left pinned.
+   *
+   * @param key	Key to search for
+   * @return		Page number of the leaf
+   */
+	template <class T>
+	PageId findLeaf(const T& key);
+
+  /**
+   * Make nextEntry refer to an existing entry, following right sibling links past the end of the
+   * current leaf. The leaf left pinned is always the one in currentPageNum.
+   *
+   * @return	False if the end of the leaf chain was reached, in which case no page is pinned
+   */
+	template <class T>
+	bool nextLeafEntry();
+
+  /**
+   * Ask the buffer manager to read ahead the right sibling of the current leaf, if the scan may go on to it.
+   */
+	template <class T>
+	void prefetchNextLeaf();
+
+  /**
+   * True if key satisfies the high bound (highVal, highOp) of the current scan.
+   */
+	template <class T>
+	bool satisfiesHigh(const T& key);
+
+
  public:
 
   /**
    * BTreeIndex Constructor. 
 	 * Check to see if the corresponding index file exists. If so, open the file.
-	 * If not, create it and insert entries for every tuple in the base relation using FileScan class.
+	 * If not, create it and insert entries for every tuple in the base relation using FileScan class,
+	 * either one at a time or by bulk loading them, depending on buildMode.
    *
    * @param relationName        Name of file.
    * @param outIndexName        Return the name of index file.
    * @param bufMgrIn						Buffer Manager Instance
    * @param attrByteOffset			Offset of attribute, over which index is to be built, in the record
    * @param attrType						Datatype of attribute over which index is built
+   * @param buildMode						How a newly created index is populated
+   * @param fillFactor					Fraction of the space of every node to fill when bulk loading
+   * @param mergeThreshold			Fraction of the space of a node below which a deletion rebalances it with a sibling
+   * @param numThreads					Number of threads of a PARALLEL_BUILD, 0 for one per hardware thread
    * @throws  BadIndexInfoException     If the index file already exists for the corresponding attribute, but values in metapage(relationName, attribute byte offset, attribute type etc.) do not match with values received through constructor parameters.
    */
 	BTreeIndex(const std::string & relationName, std::string & outIndexName,
-						BufMgr *bufMgrIn,	const int attrByteOffset,	const Datatype attrType);
+						BufMgr *bufMgrIn,	const int attrByteOffset,	const Datatype attrType,
+						const BuildMode buildMode = BULK_BUILD, const double fillFactor = DEFAULTFILLFACTOR,
+						const double mergeThreshold = DEFAULTMERGETHRESHOLD, const unsigned numThreads = 0);
 	
 
   /**
@@ -331,6 +948,40 @@ class BTreeIndex {
 	void insertEntry(const void* key, const RecordId rid);
 
 
+  /**
+	 * Delete the entry <key,rid>.
+	 * Start from root to find the leaf holding the entry and remove it. A node left with less than mergeThreshold of
+	 * its space used is merged with a sibling, or takes entries from it if the two do not fit in one node. Merging
+	 * removes a separator from the parent, which may in turn fall below the threshold. Pages of merged away nodes
+	 * are put on a free list and reused by later insertions. If the root is left with a single non-leaf child,
+	 * that child becomes the root. Any executing scan is ended first.
+   * @param key			Key of the entry to delete, pointer to integer/double/char string
+   * @param rid			Record ID of the entry to delete
+	 * @return				True if the entry was found and deleted
+	**/
+	bool deleteEntry(const void* key, const RecordId rid);
+
+
+  /**
+	 * Find the record ids of all entries with the given key.
+	 * Unlike a scan from key to key this keeps no state, so it can be called while a scan is executing.
+   * @param key			Key to look up, pointer to integer/double/char string
+   * @param outRids	Record ids of the matching entries are appended to this
+	 * @return				True if any entry has the key
+	**/
+	bool lookup(const void* key, std::vector<RecordId>& outRids);
+
+
+  /**
+	 * Find the record ids of all entries for each of a batch of keys.
+	 * The keys are sorted and resolved in order by a single walk along the leaves, which keeps its place
+	 * in the current leaf and only descends from the root again for a key past the leaf's last key.
+   * @param keys		Keys to look up, pointers to integer/double/char string
+   * @param outRids	Resized to the number of keys, outRids[i] receives the record ids of the entries with keys[i]
+	**/
+	void lookupMany(const std::vector<const void*>& keys, std::vector<std::vector<RecordId> >& outRids);
+
+
   /**
 	 * Begin a filtered scan of the index.  For instance, if the method is called 
 	 * using ("a",GT,"d",LTE) then we should seek all entries with a value 
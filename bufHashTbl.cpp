@@ -11,104 +11,113 @@
 #include "bufHashTbl.h"
 #include "exceptions/hash_already_present_exception.h"
 #include "exceptions/hash_not_found_exception.h"
-#include "exceptions/hash_table_exception.h"
 
 namespace badgerdb {
 
-int BufHashTbl::hash(const File* file, const PageId pageNo)
-{
-  int tmp, value;
-  tmp = (long)file;  // cast of pointer to the file object to an integer
-  value = (tmp + pageNo) % HTSIZE;
-  return value;
-}
-
 BufHashTbl::BufHashTbl(int htSize)
-	: HTSIZE(htSize)
+	: HTSIZE(2), numEntries(0)
 {
-  // allocate an array of pointers to hashBuckets
-  ht = new hashBucket* [htSize];
-  for(int i=0; i < HTSIZE; i++)
-    ht[i] = NULL;
+  // keep the table at most half full
+  while (HTSIZE < 2 * (std::uint32_t)htSize)
+    HTSIZE *= 2;
+
+  // allocate an array of empty hashBuckets
+  ht = new hashBucket[HTSIZE];
+  for(std::uint32_t i=0; i < HTSIZE; i++)
+    ht[i].file = NULL;
 }
 
 BufHashTbl::~BufHashTbl()
 {
-  for(int i = 0; i < HTSIZE; i++) {
-    hashBucket* tmpBuf = ht[i];
-    while (ht[i]) {
-      tmpBuf = ht[i];
-      ht[i] = ht[i]->next;
-      delete tmpBuf;
-    }
-  }
   delete [] ht;
 }
 
-void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId frameNo)
+std::uint32_t BufHashTbl::find(const File* file, const PageId pageNo) const
 {
-  int index = hash(file, pageNo);
+  std::uint32_t index = home(file, pageNo);
+  while (ht[index].file && (ht[index].file != file || ht[index].pageNo != pageNo))
+    index = (index + 1) & (HTSIZE - 1);
+  return index;
+}
 
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-  		throw HashAlreadyPresentException(tmpBuc->file->filename(), tmpBuc->pageNo, tmpBuc->frameNo);
-    tmpBuc = tmpBuc->next;
+void BufHashTbl::grow()
+{
+  hashBucket* oldHt = ht;
+  std::uint32_t oldSize = HTSIZE;
+
+  HTSIZE *= 2;
+  ht = new hashBucket[HTSIZE];
+  for(std::uint32_t i=0; i < HTSIZE; i++)
+    ht[i].file = NULL;
+
+  for(std::uint32_t i=0; i < oldSize; i++)
+  {
+    if (oldHt[i].file)
+      ht[find(oldHt[i].file, oldHt[i].pageNo)] = oldHt[i];
   }
+  delete [] oldHt;
+}
 
-  tmpBuc = new hashBucket;
-  if (!tmpBuc)
-  	throw HashTableException();
+void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId frameNo)
+{
+  std::uint32_t index = find(file, pageNo);
+  if (ht[index].file)
+		throw HashAlreadyPresentException(ht[index].file->filename(), ht[index].pageNo, ht[index].frameNo);
+
+  if (2 * (numEntries + 1) > HTSIZE)
+  {
+    grow();
+    index = find(file, pageNo);
+  }
 
-  tmpBuc->file = (File*) file;
-  tmpBuc->pageNo = pageNo;
-  tmpBuc->frameNo = frameNo;
-  tmpBuc->next = ht[index];
-  ht[index] = tmpBuc;
+  ht[index].file = (File*) file;
+  ht[index].pageNo = pageNo;
+  ht[index].frameNo = frameNo;
+  numEntries++;
 }
 
 void BufHashTbl::lookup(const File* file, const PageId pageNo, FrameId &frameNo) 
 {
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-    {
-      frameNo = tmpBuc->frameNo; // return frameNo by reference
-      return;
-    }
-    tmpBuc = tmpBuc->next;
-  }
+  if (!tryLookup(file, pageNo, frameNo))
+    throw HashNotFoundException(file->filename(), pageNo);
+}
 
-  throw HashNotFoundException(file->filename(), pageNo);
+bool BufHashTbl::tryLookup(const File* file, const PageId pageNo, FrameId &frameNo) const
+{
+  std::uint32_t index = find(file, pageNo);
+  if (!ht[index].file)
+    return false;
+
+  frameNo = ht[index].frameNo; // return frameNo by reference
+  return true;
 }
 
 void BufHashTbl::remove(const File* file, const PageId pageNo) {
 
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  hashBucket* prevBuc = NULL;
+  std::uint32_t index = find(file, pageNo);
+  if (!ht[index].file)
+    throw HashNotFoundException(file->filename(), pageNo);
 
-  while (tmpBuc)
+  // move back every later entry of the probe run that may live in the hole, so that
+  // searches never stop early at it
+  std::uint32_t next = index;
+  while (true)
 	{
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-		{
-      if(prevBuc) 
-				prevBuc->next = tmpBuc->next;
-      else
-				ht[index] = tmpBuc->next;
+    next = (next + 1) & (HTSIZE - 1);
+    if (!ht[next].file)
+      break;
 
-      delete tmpBuc;
-      return;
-    }
-		else
+    // an entry may move to the hole unless its home lies cyclically in (index, next]
+    std::uint32_t entryHome = home(ht[next].file, ht[next].pageNo);
+    if (((next - entryHome) & (HTSIZE - 1)) >= ((next - index) & (HTSIZE - 1)))
 		{
-      prevBuc = tmpBuc;
-      tmpBuc = tmpBuc->next;
+      ht[index] = ht[next];
+      index = next;
     }
   }
 
-  throw HashNotFoundException(file->filename(), pageNo);
+  ht[index].file = NULL;
+  numEntries--;
 }
 
 }
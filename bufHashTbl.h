@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include "file.h"
 
 namespace badgerdb {
@@ -16,7 +17,7 @@ namespace badgerdb {
 */
 struct hashBucket {
 	/**
-	 * pointer a file object (more on this below)
+	 * pointer a file object (more on this below). NULL if the bucket is empty
 	 */
 	File *file;
 
@@ -29,43 +30,84 @@ struct hashBucket {
 	 * frame number of page in the buffer pool
 	 */
 	FrameId frameNo;
-
-	/**
-	 * Next node in the hash table
-	 */
-	hashBucket*   next;
 };
 
 
 /**
 * @brief Hash table class to keep track of pages in the buffer pool
 *
+* The table is a flat array of buckets searched by linear probing. A removed entry is filled by
+* shifting later entries of its probe run back, so no tombstones are left behind. The array is
+* doubled when it becomes half full; once it has grown to the number of pages kept in the buffer
+* pool, inserts and removes do not allocate.
+*
 * @warning This class is not threadsafe.
 */
 class BufHashTbl
 {
  private:
 	/**
-	 *	Size of Hash Table
+	 *	Number of buckets, a power of two
 	 */
-  int HTSIZE;
+  std::uint32_t HTSIZE;
+
+	/**
+	 *	Number of entries in the table
+	 */
+  std::uint32_t numEntries;
+
 	/**
 	 * Actual Hash table object
 	 */
-  hashBucket**  ht;
+  hashBucket*  ht;
 
 	/**
-	 * returns hash value between 0 and HTSIZE-1 computed using file and pageNo
+	 * Bucket in which the search for (file, pageNo) starts
 	 *
 	 * @param file   	File object
 	 * @param pageNo  Page number in the file
-	 * @return  			Hash value.
+	 * @return  			Bucket number between 0 and HTSIZE-1
+	 */
+  std::uint32_t home(const File* file, const PageId pageNo) const
+  {
+		return hash(file, pageNo) & (HTSIZE - 1);
+  }
+
+	/**
+	 * Bucket holding (file, pageNo), or the empty bucket that ends its probe run
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @return  			Bucket number between 0 and HTSIZE-1
+	 */
+  std::uint32_t find(const File* file, const PageId pageNo) const;
+
+	/**
+	 * Move all entries to a table twice as large
 	 */
-  int	 hash(const File* file, const PageId pageNo);
+  void grow();
 
  public:
 	/**
+	 * returns hash value computed using file and pageNo. Both the low and the high bits are well mixed,
+	 * so the value can also be used to pick one of several tables.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @return  			Hash value.
+	 */
+  static std::uint64_t hash(const File* file, const PageId pageNo)
+  {
+		std::uint64_t value = (std::uint64_t)(std::uintptr_t)file * 0x9e3779b97f4a7c15ULL + pageNo;
+		value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+		return value ^ (value >> 31);
+  }
+
+	/**
    * Constructor of BufHashTbl class
+   *
+   * @param htSize	Number of entries the table is expected to hold
 	 */
 	BufHashTbl(const int htSize);  // constructor
 
@@ -81,7 +123,6 @@ class BufHashTbl
 	 * @param pageNo 	Page number in the file
 	 * @param frameNo Frame number assigned to that page of the file
    * @throws  HashAlreadyPresentException	if the corresponding page already exists in the hash table
-   * @throws  HashTableException (optional) if could not create a new bucket as running of memory
 	 */
   void insert(const File* file, const PageId pageNo, const FrameId frameNo);
 
@@ -96,6 +137,17 @@ class BufHashTbl
 	 */
   void lookup(const File* file, const PageId pageNo, FrameId &frameNo);
 
+	/**
+   * Check if (file, pageNo) is currently in the buffer pool (ie. in
+   * the hash table), without throwing if it is not.
+	 *
+	 * @param file  	File object
+	 * @param pageNo	Page number in the file
+	 * @param frameNo Frame number reference, set only if the page is found
+	 * @return				True if the page entry is found in the hash table
+	 */
+  bool tryLookup(const File* file, const PageId pageNo, FrameId &frameNo) const;
+
 	/**
    * Delete entry (file,pageNo) from hash table.
 	 *
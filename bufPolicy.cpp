@@ -0,0 +1,305 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include "buffer.h"
+#include "bufHashTbl.h"
+#include "bufPolicy.h"
+
+namespace badgerdb {
+
+BufPolicy* BufPolicy::create(const ReplacementPolicy policy, const std::uint32_t bufs, BufDesc* bufDescTable)
+{
+	switch (policy)
+	{
+		case TWO_Q:
+			return new TwoQPolicy(bufs, bufDescTable);
+		case ARC:
+			return new ArcPolicy(bufs, bufDescTable);
+		default:
+			return new ClockPolicy(bufs, bufDescTable);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// ClockPolicy
+// -----------------------------------------------------------------------------
+
+ClockPolicy::ClockPolicy(const std::uint32_t bufs, BufDesc* descTable)
+	: clockHand(bufs - 1), numBufs(bufs), bufDescTable(descTable)
+{
+}
+
+bool ClockPolicy::replace(const FrameClaimer& claim, FrameId& frameNo)
+{
+  // threads advance the shared clock hand on their own, and frames are
+  // taken by pinning them rather than under a lock
+  for (std::uint32_t numScanned = 0; numScanned < 2*numBufs; numScanned++)	//Need to scn twice
+  {
+    // advance the clock
+    const FrameId frame = advanceClock();
+    BufDesc& desc = bufDescTable[frame];
+
+    // has been referenced, clear the bit
+    if (desc.valid && desc.refbit.exchange(false))
+      continue;
+
+    // hasn't been referenced and is not pinned, use it
+    if (desc.pinCnt == 0 && claim(frame))
+    {
+      frameNo = frame;
+      return true;
+    }
+  }
+  return false;
+}
+
+// -----------------------------------------------------------------------------
+// FrameLists
+// -----------------------------------------------------------------------------
+
+const int FrameLists::NONE;
+const FrameId FrameLists::END;
+
+FrameLists::FrameLists(const std::uint32_t bufs, const int numLists)
+	: next(bufs, END), prev(bufs, END), member(bufs, NONE),
+		heads(numLists, END), tails(numLists, END), sizes(numLists, 0)
+{
+}
+
+void FrameLists::pushHead(const int list, const FrameId frameNo)
+{
+	remove(frameNo);
+
+	prev[frameNo] = END;
+	next[frameNo] = heads[list];
+	if (heads[list] != END)
+		prev[heads[list]] = frameNo;
+	else
+		tails[list] = frameNo;
+	heads[list] = frameNo;
+	member[frameNo] = list;
+	sizes[list]++;
+}
+
+void FrameLists::remove(const FrameId frameNo)
+{
+	const int list = member[frameNo];
+	if (list == NONE)
+		return;
+
+	if (prev[frameNo] != END)
+		next[prev[frameNo]] = next[frameNo];
+	else
+		heads[list] = next[frameNo];
+	if (next[frameNo] != END)
+		prev[next[frameNo]] = prev[frameNo];
+	else
+		tails[list] = prev[frameNo];
+	member[frameNo] = NONE;
+	sizes[list]--;
+}
+
+// -----------------------------------------------------------------------------
+// GhostList
+// -----------------------------------------------------------------------------
+
+std::size_t GhostList::PageKeyHash::operator()(const PageKey& key) const
+{
+	return BufHashTbl::hash(key.file, key.pageNo);
+}
+
+void GhostList::push(const File* file, const PageId pageNo)
+{
+	erase(file, pageNo);
+	PageKey key = { file, pageNo };
+	pages.push_front(key);
+	positions[key] = pages.begin();
+}
+
+bool GhostList::erase(const File* file, const PageId pageNo)
+{
+	PageKey key = { file, pageNo };
+	std::unordered_map<PageKey, std::list<PageKey>::iterator, PageKeyHash>::iterator it = positions.find(key);
+	if (it == positions.end())
+		return false;
+
+	pages.erase(it->second);
+	positions.erase(it);
+	return true;
+}
+
+void GhostList::popOldest()
+{
+	positions.erase(pages.back());
+	pages.pop_back();
+}
+
+// -----------------------------------------------------------------------------
+// ListPolicy
+// -----------------------------------------------------------------------------
+
+ListPolicy::ListPolicy(const std::uint32_t bufs, const int numLists, BufDesc* descTable)
+	: numBufs(bufs), lists(bufs, numLists), files(bufs, NULL), pageNos(bufs, (PageId)Page::INVALID_NUMBER),
+		bufDescTable(descTable)
+{
+	for (FrameId i = 0; i < bufs; i++)
+		lists.pushHead(FREE, i);
+}
+
+bool ListPolicy::claimFromTail(const int list, const FrameClaimer& claim, FrameId& frameNo)
+{
+	for (FrameId frame = lists.tail(list); frame != FrameLists::END; frame = lists.towardsHead(frame))
+	{
+		if (bufDescTable[frame].dirty)
+			continue;
+		if (claim(frame))
+		{
+			lists.remove(frame);
+			frameNo = frame;
+			return true;
+		}
+	}
+	return false;
+}
+
+void ListPolicy::removed(const FrameId frameNo)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	lists.pushHead(FREE, frameNo);
+	files[frameNo] = NULL;
+	pageNos[frameNo] = Page::INVALID_NUMBER;
+}
+
+// -----------------------------------------------------------------------------
+// TwoQPolicy
+// -----------------------------------------------------------------------------
+
+TwoQPolicy::TwoQPolicy(const std::uint32_t bufs, BufDesc* bufDescTable)
+	: ListPolicy(bufs, 3, bufDescTable), maxIn(std::max(bufs / 4, 1u)), maxOut(std::max(bufs / 2, 1u))
+{
+}
+
+bool TwoQPolicy::replace(const FrameClaimer& claim, FrameId& frameNo)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	if (claimFromTail(FREE, claim, frameNo))
+		return true;
+
+	// replace from the FIFO queue while it is over its share, falling back on
+	// the other list if every frame of the first is pinned
+	const int first = lists.size(A1IN) > maxIn || lists.size(AM) == 0 ? A1IN : AM;
+	const int order[2] = { first, first == A1IN ? AM : A1IN };
+	for (int i = 0; i < 2; i++)
+	{
+		if (claimFromTail(order[i], claim, frameNo))
+		{
+			if (order[i] == A1IN)
+			{
+				a1out.push(files[frameNo], pageNos[frameNo]);
+				if (a1out.size() > maxOut)
+					a1out.popOldest();
+			}
+			files[frameNo] = NULL;
+			pageNos[frameNo] = Page::INVALID_NUMBER;
+			return true;
+		}
+	}
+	return false;
+}
+
+void TwoQPolicy::loaded(const FrameId frameNo, const File* file, const PageId pageNo)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	files[frameNo] = file;
+	pageNos[frameNo] = pageNo;
+
+	// a page requested again after it was replaced from the FIFO queue is used repeatedly
+	lists.pushHead(a1out.erase(file, pageNo) ? AM : A1IN, frameNo);
+}
+
+void TwoQPolicy::accessed(const FrameId frameNo)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	if (lists.listOf(frameNo) == AM)
+		lists.pushHead(AM, frameNo);
+}
+
+// -----------------------------------------------------------------------------
+// ArcPolicy
+// -----------------------------------------------------------------------------
+
+ArcPolicy::ArcPolicy(const std::uint32_t bufs, BufDesc* bufDescTable)
+	: ListPolicy(bufs, 3, bufDescTable), target(0)
+{
+}
+
+bool ArcPolicy::replace(const FrameClaimer& claim, FrameId& frameNo)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	if (claimFromTail(FREE, claim, frameNo))
+		return true;
+
+	// replace from T1 while it is over its target, falling back on the other
+	// list if every frame of the first is pinned
+	const int first = lists.size(T1) > 0 && (lists.size(T1) > target || lists.size(T2) == 0) ? T1 : T2;
+	const int order[2] = { first, first == T1 ? T2 : T1 };
+	for (int i = 0; i < 2; i++)
+	{
+		if (claimFromTail(order[i], claim, frameNo))
+		{
+			(order[i] == T1 ? b1 : b2).push(files[frameNo], pageNos[frameNo]);
+			files[frameNo] = NULL;
+			pageNos[frameNo] = Page::INVALID_NUMBER;
+			return true;
+		}
+	}
+	return false;
+}
+
+void ArcPolicy::loaded(const FrameId frameNo, const File* file, const PageId pageNo)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	files[frameNo] = file;
+	pageNos[frameNo] = pageNo;
+
+	const std::uint32_t b1Size = b1.size();
+	const std::uint32_t b2Size = b2.size();
+	if (b1.erase(file, pageNo))
+	{
+		// T1 would have kept the page had it been larger
+		target = std::min(target + std::max(b2Size / b1Size, 1u), numBufs);
+		lists.pushHead(T2, frameNo);
+	}
+	else if (b2.erase(file, pageNo))
+	{
+		// T2 would have kept the page had it been larger
+		const std::uint32_t delta = std::max(b1Size / b2Size, 1u);
+		target = target > delta ? target - delta : 0;
+		lists.pushHead(T2, frameNo);
+	}
+	else
+	{
+		lists.pushHead(T1, frameNo);
+
+		// remember at most as many pages as the pool holds for each list
+		while (b1.size() > 0 && lists.size(T1) + b1.size() > numBufs)
+			b1.popOldest();
+		while (b2.size() > 0 && lists.size(T1) + lists.size(T2) + b1.size() + b2.size() > 2 * numBufs)
+			b2.popOldest();
+	}
+}
+
+void ArcPolicy::accessed(const FrameId frameNo)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	const int list = lists.listOf(frameNo);
+	if (list == T1 || list == T2)
+		lists.pushHead(T2, frameNo);
+}
+
+}
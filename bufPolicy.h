@@ -0,0 +1,395 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "file.h"
+
+namespace badgerdb {
+
+class BufDesc;
+
+/**
+ * @brief Page replacement policies the buffer manager can be built with.
+ */
+enum ReplacementPolicy
+{
+	CLOCK,
+	TWO_Q,
+	ARC
+};
+
+/**
+ * @brief Tries to take a frame for a new page. Returns true if the frame was taken, false if it is pinned.
+ */
+typedef std::function<bool(const FrameId)> FrameClaimer;
+
+
+/**
+* @brief Decides which frame of the buffer pool is given to a page that is read in
+*
+* The buffer manager tells the policy about every page placed in a frame, every access to a page in the
+* pool and every page dropped without being replaced. A frame chosen by replace() is only used if the
+* claimer succeeds in taking it; otherwise the policy moves on to its next candidate. The methods may be
+* called from several threads at once.
+*/
+class BufPolicy
+{
+ public:
+	/**
+   * Destructor of BufPolicy class
+	 */
+	virtual ~BufPolicy() {}
+
+	/**
+	 * Choose a frame for a page that is to be read in, and take it using the claimer.
+	 *
+	 * @param claim   	Takes the frame if it is not pinned
+	 * @param frameNo 	Set to the frame taken
+	 * @return					False if no frame could be taken
+	 */
+	virtual bool replace(const FrameClaimer& claim, FrameId& frameNo) = 0;
+
+	/**
+	 * The page (file, pageNo) was placed in a frame returned by replace().
+	 *
+	 * @param frameNo  	Frame number
+	 * @param file   		File object
+	 * @param pageNo  	Page number in the file
+	 */
+	virtual void loaded(const FrameId frameNo, const File* file, const PageId pageNo) = 0;
+
+	/**
+	 * The page in the frame was requested again.
+	 *
+	 * @param frameNo  	Frame number
+	 */
+	virtual void accessed(const FrameId frameNo) = 0;
+
+	/**
+	 * The frame no longer holds a page. Called while the frame is still pinned.
+	 *
+	 * @param frameNo  	Frame number
+	 */
+	virtual void removed(const FrameId frameNo) = 0;
+
+	/**
+	 * Create a policy of the given type.
+	 *
+	 * @param policy  			Type of the policy
+	 * @param bufs  				Number of frames in the buffer pool
+	 * @param bufDescTable	Descriptors of the frames
+	 * @return							The new policy, to be deleted by the caller
+	 */
+	static BufPolicy* create(const ReplacementPolicy policy, const std::uint32_t bufs, BufDesc* bufDescTable);
+};
+
+
+/**
+* @brief The CLOCK policy. Frames are swept in order and taken unless their reference bit is set, in which
+* case the bit is cleared. Accesses only set the bit in the frame's descriptor, so no lock is taken.
+*/
+class ClockPolicy : public BufPolicy
+{
+ private:
+	/**
+   * Current position of clockhand in our buffer pool
+	 */
+	std::atomic<FrameId> clockHand;
+
+	/**
+   * Number of frames in the buffer pool
+	 */
+	std::uint32_t numBufs;
+
+	/**
+   * Descriptors of the frames, which hold the reference bits
+	 */
+	BufDesc* bufDescTable;
+
+	/**
+   * Advance clock to next frame in the buffer pool and return it
+	 */
+	FrameId advanceClock()
+	{
+		return (clockHand.fetch_add(1) + 1) % numBufs;
+	}
+
+ public:
+	ClockPolicy(const std::uint32_t bufs, BufDesc* bufDescTable);
+
+	bool replace(const FrameClaimer& claim, FrameId& frameNo);
+	void loaded(const FrameId, const File*, const PageId) {}
+	void accessed(const FrameId) {}
+	void removed(const FrameId) {}
+};
+
+
+/**
+* @brief Doubly linked lists of frames. Every frame is on at most one of the lists, and the links are kept in
+* arrays indexed by frame number, so moving frames between lists does not allocate.
+*/
+class FrameLists
+{
+ private:
+	/**
+   * Next and previous frame on the frame's list, towards the tail and the head
+	 */
+	std::vector<FrameId> next, prev;
+
+	/**
+   * List each frame is on, or NONE
+	 */
+	std::vector<int> member;
+
+	/**
+   * First and last frame of each list
+	 */
+	std::vector<FrameId> heads, tails;
+
+	/**
+   * Number of frames on each list
+	 */
+	std::vector<std::uint32_t> sizes;
+
+ public:
+	/**
+   * List number of frames that are on no list, and frame number that ends a list
+	 */
+	static const int NONE = -1;
+	static const FrameId END = ~(FrameId)0;
+
+	FrameLists(const std::uint32_t bufs, const int numLists);
+
+	/**
+   * List the frame is on, or NONE
+	 */
+	int listOf(const FrameId frameNo) const { return member[frameNo]; }
+
+	/**
+   * Number of frames on the list
+	 */
+	std::uint32_t size(const int list) const { return sizes[list]; }
+
+	/**
+   * Least recently added frame of the list, or END
+	 */
+	FrameId tail(const int list) const { return tails[list]; }
+
+	/**
+   * Frame added to the list before this one, or END
+	 */
+	FrameId towardsHead(const FrameId frameNo) const { return prev[frameNo]; }
+
+	/**
+   * Add the frame to the head of the list, taking it off its current list first
+	 */
+	void pushHead(const int list, const FrameId frameNo);
+
+	/**
+   * Take the frame off its list, if it is on one
+	 */
+	void remove(const FrameId frameNo);
+};
+
+
+/**
+* @brief Pages recently replaced, kept in the order they were replaced and at most a given number of them
+*/
+class GhostList
+{
+ private:
+	/**
+   * (File, page) pair identifying a page
+	 */
+	struct PageKey
+	{
+		const File* file;
+		PageId pageNo;
+
+		bool operator==(const PageKey& other) const
+		{
+			return file == other.file && pageNo == other.pageNo;
+		}
+	};
+
+	/**
+   * Hash of a PageKey
+	 */
+	struct PageKeyHash
+	{
+		std::size_t operator()(const PageKey& key) const;
+	};
+
+	/**
+   * Pages, most recently replaced first
+	 */
+	std::list<PageKey> pages;
+
+	/**
+   * Position of each page in the list
+	 */
+	std::unordered_map<PageKey, std::list<PageKey>::iterator, PageKeyHash> positions;
+
+ public:
+	/**
+   * Number of pages in the list
+	 */
+	std::uint32_t size() const { return (std::uint32_t)pages.size(); }
+
+	/**
+   * Add a page to the list
+	 */
+	void push(const File* file, const PageId pageNo);
+
+	/**
+   * Remove a page from the list. Returns true if it was in it.
+	 */
+	bool erase(const File* file, const PageId pageNo);
+
+	/**
+   * Forget the least recently replaced page
+	 */
+	void popOldest();
+};
+
+
+/**
+* @brief State shared by the policies that keep frames on lists: the lists, the page held by each frame
+* and the lock guarding them. Frames not holding a page are kept on a free list and given out first.
+*/
+class ListPolicy : public BufPolicy
+{
+ protected:
+	/**
+   * List of the frames not holding a page
+	 */
+	static const int FREE = 0;
+
+	/**
+   * Number of frames in the buffer pool
+	 */
+	std::uint32_t numBufs;
+
+	/**
+   * Held while any of the state is used
+	 */
+	std::mutex lock;
+
+	/**
+   * Lists the frames are kept on
+	 */
+	FrameLists lists;
+
+	/**
+   * Page held by each frame
+	 */
+	std::vector<const File*> files;
+	std::vector<PageId> pageNos;
+
+	/**
+   * Descriptors of the frames, which tell which pages are dirty
+	 */
+	BufDesc* bufDescTable;
+
+	/**
+	 * Take the first frame that can be claimed, starting at the tail of the list. Frames holding dirty
+	 * pages are passed over, so that no page is written back while the lock is held; they are left to
+	 * the buffer manager, which writes them back once no clean frame is left.
+	 *
+	 * @param list  	List to search
+	 * @param claim   Takes the frame if it is not pinned
+	 * @param frameNo Set to the frame taken, which is left on no list
+	 * @return				False if no frame of the list could be taken
+	 */
+	bool claimFromTail(const int list, const FrameClaimer& claim, FrameId& frameNo);
+
+ public:
+	ListPolicy(const std::uint32_t bufs, const int numLists, BufDesc* bufDescTable);
+
+	void removed(const FrameId frameNo);
+};
+
+
+/**
+* @brief The 2Q policy of Johnson and Shasha. Pages read in for the first time go to a FIFO queue and are
+* replaced from it unless they are requested again after being replaced, in which case they go to an LRU
+* list. A page read once by a scan therefore never pushes out pages that are used repeatedly.
+*/
+class TwoQPolicy : public ListPolicy
+{
+ private:
+	/**
+   * FIFO queue of pages read in once, and LRU list of the pages that were requested again
+	 */
+	static const int A1IN = 1;
+	static const int AM = 2;
+
+	/**
+   * Largest number of frames kept on the FIFO queue
+	 */
+	std::uint32_t maxIn;
+
+	/**
+   * Largest number of pages remembered after being replaced from the FIFO queue
+	 */
+	std::uint32_t maxOut;
+
+	/**
+   * Pages recently replaced from the FIFO queue
+	 */
+	GhostList a1out;
+
+ public:
+	TwoQPolicy(const std::uint32_t bufs, BufDesc* bufDescTable);
+
+	bool replace(const FrameClaimer& claim, FrameId& frameNo);
+	void loaded(const FrameId frameNo, const File* file, const PageId pageNo);
+	void accessed(const FrameId frameNo);
+};
+
+
+/**
+* @brief The ARC policy of Megiddo and Modha. Pages requested once and pages requested more than once are
+* kept on separate LRU lists, and the pages recently replaced from each list are remembered. Requests for
+* remembered pages move the target size of the first list towards the list that would have kept them.
+*/
+class ArcPolicy : public ListPolicy
+{
+ private:
+	/**
+   * LRU lists of pages requested once and of pages requested more than once
+	 */
+	static const int T1 = 1;
+	static const int T2 = 2;
+
+	/**
+   * Target number of frames on T1
+	 */
+	std::uint32_t target;
+
+	/**
+   * Pages recently replaced from T1 and from T2
+	 */
+	GhostList b1, b2;
+
+ public:
+	ArcPolicy(const std::uint32_t bufs, BufDesc* bufDescTable);
+
+	bool replace(const FrameClaimer& claim, FrameId& frameNo);
+	void loaded(const FrameId frameNo, const File* file, const PageId pageNo);
+	void accessed(const FrameId frameNo);
+};
+
+}
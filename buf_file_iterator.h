@@ -0,0 +1,218 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cassert>
+#include <utility>
+#include "buffer.h"
+#include "file.h"
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Iterator for iterating over the pages in a file through the buffer
+ * pool.
+ *
+ * Unlike FileIterator, which reads every page header from the file to find
+ * the next page, this iterator keeps the current page pinned in the buffer
+ * pool and takes the number of the next page from it, so each page is read
+ * from the file at most once.  The current page is unpinned when the
+ * iterator moves on or is destroyed.
+ */
+class BufFileIterator {
+ public:
+  /**
+   * Constructs an empty iterator, which pins no page.
+   */
+  BufFileIterator()
+      : file_(NULL),
+        buf_mgr_(NULL),
+        ring_(NULL),
+        page_(NULL),
+        current_page_number_(Page::INVALID_NUMBER),
+        dirty_(false) {
+  }
+
+  /**
+   * Constructs an iterator over the pages in a file, pinning the first page.
+   *
+   * @param file     File to iterate over.
+   * @param buf_mgr  Buffer manager the pages are read through.
+   * @param ring     Frames to read the pages into, or NULL.
+   */
+  BufFileIterator(PageFile* file, BufMgr* buf_mgr, BufRing* ring = NULL)
+      : file_(file),
+        buf_mgr_(buf_mgr),
+        ring_(ring),
+        page_(NULL),
+        current_page_number_(Page::INVALID_NUMBER),
+        dirty_(false) {
+    assert(file_ != NULL && buf_mgr_ != NULL);
+    pin(file_->getFirstPageNo());
+  }
+
+  /**
+   * Moves the pin of another iterator to this one, leaving the other empty.
+   *
+   * @param other   Iterator to move.
+   */
+  BufFileIterator(BufFileIterator&& other)
+      : BufFileIterator() {
+    *this = std::move(other);
+  }
+
+  BufFileIterator& operator=(BufFileIterator&& rhs) {
+    if (this != &rhs) {
+      unpin();
+      file_ = rhs.file_;
+      buf_mgr_ = rhs.buf_mgr_;
+      ring_ = rhs.ring_;
+      page_ = rhs.page_;
+      current_page_number_ = rhs.current_page_number_;
+      dirty_ = rhs.dirty_;
+      rhs.page_ = NULL;
+      rhs.current_page_number_ = Page::INVALID_NUMBER;
+      rhs.dirty_ = false;
+    }
+    return *this;
+  }
+
+  BufFileIterator(const BufFileIterator&) = delete;
+  BufFileIterator& operator=(const BufFileIterator&) = delete;
+
+  /**
+   * Destructor that unpins the current page.
+   */
+  ~BufFileIterator() {
+    unpin();
+  }
+
+  /**
+   * Advances the iterator to the next page in the file, unpinning the current
+   * page.
+   */
+  inline BufFileIterator& operator++() {
+    assert(page_ != NULL);
+    const PageId next_page_number = page_->next_page_number();
+    unpin();
+    pin(next_page_number);
+    return *this;
+  }
+
+  /**
+   * Returns true if this iterator is at the same page of the same file object
+   * as the given iterator.
+   *
+   * @param rhs   Iterator to compare against.
+   * @return    True if other iterator is equal to this one.
+   */
+  inline bool operator==(const BufFileIterator& rhs) const {
+    return file_ == rhs.file_ &&
+        current_page_number_ == rhs.current_page_number_;
+  }
+
+  inline bool operator!=(const BufFileIterator& rhs) const {
+    return !(*this == rhs);
+  }
+
+  /**
+   * Returns true if the iterator has gone past the last page of the file,
+   * or is empty.
+   */
+  inline bool atEnd() const {
+    return page_ == NULL;
+  }
+
+  /**
+   * Dereferences the iterator, returning the current page in its frame.
+   *
+   * @return  Page in the buffer pool.
+   */
+  inline Page& operator*() const {
+    assert(page_ != NULL);
+    return *page_;
+  }
+
+  inline Page* operator->() const {
+    assert(page_ != NULL);
+    return page_;
+  }
+
+  /**
+   * Marks the current page dirty, so that it is written back once unpinned.
+   */
+  inline void markDirty() {
+    dirty_ = true;
+  }
+
+  /**
+   * Returns the number of the current page.
+   *
+   * @return  Number of the current page.
+   */
+  inline PageId getCurrentPageNumber() const {
+    return current_page_number_;
+  }
+
+ private:
+  /**
+   * Pins the given page and makes it the current page, unless it ends the
+   * list of pages.
+   */
+  void pin(const PageId page_number) {
+    current_page_number_ = page_number;
+    if (page_number != Page::INVALID_NUMBER) {
+      buf_mgr_->readPage(file_, page_number, page_, ring_);
+    }
+  }
+
+  /**
+   * Unpins the current page, if there is one.
+   */
+  void unpin() {
+    if (page_ != NULL) {
+      buf_mgr_->unPinPage(file_, current_page_number_, dirty_);
+      page_ = NULL;
+      dirty_ = false;
+    }
+  }
+
+  /**
+   * File we're iterating over.
+   */
+  PageFile* file_;
+
+  /**
+   * Buffer manager the pages are read through.
+   */
+  BufMgr* buf_mgr_;
+
+  /**
+   * Frames the pages are read into, or NULL.
+   */
+  BufRing* ring_;
+
+  /**
+   * The current page, pinned in the buffer pool, or NULL at the end.
+   */
+  Page* page_;
+
+  /**
+   * Number of page in file iterator is currently pointing to.
+   */
+  PageId current_page_number_;
+
+  /**
+   * True if the current page has been changed.
+   */
+  bool dirty_;
+};
+
+}
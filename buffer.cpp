@@ -5,14 +5,17 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
 #include <memory>
+#include <new>
 #include <iostream>
 #include "buffer.h"
 #include "exceptions/buffer_exceeded_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
 #include "exceptions/bad_buffer_exception.h"
-#include "exceptions/hash_not_found_exception.h"
 
 namespace badgerdb { 
 
@@ -20,8 +23,8 @@ namespace badgerdb {
 // Constructor of the class BufMgr
 //----------------------------------------
 
-BufMgr::BufMgr(std::uint32_t bufs)
-	: numBufs(bufs) {
+BufMgr::BufMgr(std::uint32_t bufs, const ReplacementPolicy replacementPolicy)
+	: numBufs(bufs), prefetchStopping(false), writerStopping(false), writerCursor(0) {
 	bufDescTable = new BufDesc[bufs];
 
   for (FrameId i = 0; i < bufs; i++) 
@@ -30,142 +33,537 @@ BufMgr::BufMgr(std::uint32_t bufs)
   	bufDescTable[i].valid = false;
   }
 
-  bufPool = new Page[bufs];
+  // frames are aligned to pages, so that files opened with O_DIRECT read into them in place
+  void* frames = NULL;
+  if (posix_memalign(&frames, Page::SIZE, bufs * sizeof(Page)) != 0)
+    throw std::bad_alloc();
+  bufPool = static_cast<Page*>(frames);
+  for (FrameId i = 0; i < bufs; i++)
+  {
+    new (&bufPool[i]) Page();
+  }
 
   int htsize = ((((int) (bufs * 1.2))*2)/2)+1;
-  hashTable = new BufHashTbl (htsize);  // allocate the buffer hash table
+  hashPartitions = new BufHashPartition[BUFHASHPARTITIONS];
+  for (std::uint32_t i = 0; i < BUFHASHPARTITIONS; i++)
+  {
+  	hashPartitions[i].table = new BufHashTbl(htsize / BUFHASHPARTITIONS + 1);  // allocate the buffer hash table
+  }
 
-  clockHand = bufs - 1;
+  policy = BufPolicy::create(replacementPolicy, bufs, bufDescTable);
 }
 
 
 BufMgr::~BufMgr() {
+  //Stop reading ahead
+  {
+    std::lock_guard<std::mutex> guard(prefetchMutex);
+    prefetchStopping = true;
+  }
+  prefetchReady.notify_all();
+  for (std::size_t i = 0; i < prefetchThreads.size(); i++)
+  {
+    prefetchThreads[i].join();
+  }
+
+  //Stop writing in the background
+  {
+    std::lock_guard<std::mutex> guard(writerMutex);
+    writerStopping = true;
+  }
+  writerWake.notify_all();
+  if (writerThread.joinable())
+    writerThread.join();
+
   //Flush out all unwritten pages
   for (std::uint32_t i = 0; i < numBufs; i++) 
   {
   	BufDesc* tmpbuf = &(bufDescTable[i]);
   	if (tmpbuf->valid == true && tmpbuf->dirty == true)
 		{
-			tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
+			tmpbuf->file.load()->writePage(tmpbuf->pageNo, bufPool[i]);
   	}
   }
 
-	delete hashTable;
+  for (std::uint32_t i = 0; i < BUFHASHPARTITIONS; i++)
+  {
+		delete hashPartitions[i].table;
+  }
+	delete [] hashPartitions;
+  delete policy;
   delete [] bufDescTable;
-  delete [] bufPool;
+  std::free(bufPool);
 }
 
 void BufMgr::allocBuf(FrameId & frame) 
 {
-  // perform first part of clock algorithm to search for 
-  // open buffer frame
-  // Assumes non-concurrent access to buffer manager
-  std::uint32_t numScanned = 0;
-  bool found = 0;
+  // the policy picks the frame, which is taken only if it is not pinned
+  const FrameClaimer claim = [this](const FrameId frameNo) { return claimFrame(frameNo); };
+  if (policy->replace(claim, frame))
+    return;
+
+  // frames being written in the background are only pinned until the pass is done. The list policies
+  // pass over dirty frames, so while those are all that is left, write batches of them back here,
+  // outside the policy's lock, as the background writer would. No other pass can pin frames before
+  // the policy is asked again, but other threads may still take the frames cleaned.
+  std::lock_guard<std::mutex> writing(writerMutex);
+  if (policy->replace(claim, frame))
+    return;
+  while (writeDirtyPages(BUFWRITERBATCH) > 0)
+  {
+    if (policy->replace(claim, frame))
+      return;
+  }
+  throw BufferExceededException();
+} // end allocBuf
 
-  while (numScanned < 2*numBufs)	//Need to scn twice
+void BufRing::add(const FrameId frameNo, const File* file, const PageId pageNo)
+{
+  Entry entry = { frameNo, file, pageNo };
+  if (entries.size() < capacity)
   {
-    // advance the clock
-    advanceClock();
-    numScanned++;
+    entries.push_back(entry);
+    return;
+  }
+  entries[next] = entry;
+  next = (next + 1) % capacity;
+}
+
+bool BufMgr::claimFrame(const FrameId frameNo, const File* expectedFile, const PageId expectedPageNo)
+{
+  BufDesc& desc = bufDescTable[frameNo];
+  int unpinned = 0;
+  if (!desc.pinCnt.compare_exchange_strong(unpinned, 1))
+    return false;
 
-    // if invalid, use frame
-    if (! bufDescTable[clockHand].valid)
+  // once pinned, the frame cannot be given another page by someone else
+  if (expectedFile != NULL && (!desc.valid || desc.file != expectedFile || desc.pageNo != expectedPageNo))
+  {
+    desc.pinCnt--;
+    return false;
+  }
+
+  // not assigned to a page, so not in the hash table either
+  if (!desc.valid)
+    return true;
+
+  // flush any existing changes to disk if necessary. The page stays in the hash
+  // table until it is written, so that nobody reads the old copy from disk.
+  File* file = desc.file;
+  const PageId pageNo = desc.pageNo;
+  if (desc.dirty.exchange(false))
+  {
+    // the background writer has fallen behind
+    writerWake.notify_one();
+    try
     {
-      break;
+      std::lock_guard<std::mutex> latch(desc.latch);
+      file->writePage(pageNo, bufPool[frameNo]);
     }
+    catch (...)
+    {
+      desc.dirty = true;
+      desc.pinCnt--;
+      throw;
+    }
+    bufStats.diskwrites++;
+  }
+
+  // give the frame up if someone pinned or changed the page in the meantime
+  BufHashPartition& partition = hashPartition(file, pageNo);
+  std::lock_guard<std::mutex> guard(partition.lock);
+  if (desc.pinCnt != 1 || desc.dirty)
+  {
+    desc.pinCnt--;
+    return false;
+  }
+  partition.table->remove(file, pageNo);
+
+	//Reset all the BufDesc entry for the frame, except the pin that keeps it ours
+  desc.file = NULL;
+  desc.pageNo = Page::INVALID_NUMBER;
+  desc.refbit = false;
+  desc.valid = false;
+  return true;
+}
+
+	
+bool BufMgr::claimRingFrame(BufRing& ring, FrameId& frameNo)
+{
+  if (ring.entries.size() < ring.capacity)
+    return false;
+
+  const BufRing::Entry& entry = ring.entries[ring.next];
+  if (!claimFrame(entry.frameNo, entry.file, entry.pageNo))
+    return false;
+
+  // the frame leaves the policy's lists, and comes back with the new page
+  policy->removed(entry.frameNo);
+  frameNo = entry.frameNo;
+  return true;
+}
+
+bool BufMgr::tryReadPage(File* file, const PageId pageNo, Page*& page)
+{
+  return pinPage(file, pageNo, page, true);
+}
+
+bool BufMgr::pinPage(File* file, const PageId pageNo, Page*& page, const bool access)
+{
+  // check to see if it is already in the buffer pool, and pin it while the
+  // partition is locked so that it cannot be evicted first
+  FrameId frameNo = 0;
+  BufHashPartition& partition = hashPartition(file, pageNo);
+  {
+    std::lock_guard<std::mutex> guard(partition.lock);
+    if (!partition.table->tryLookup(file, pageNo, frameNo))
+      return false;
+    bufDescTable[frameNo].pinCnt++;
+  }
+
+  BufDesc& desc = bufDescTable[frameNo];
+  // set the referenced bit, unless this is the first request for a page read ahead
+  if (access && !desc.prefetched.exchange(false))
+  {
+    desc.refbit = true;
+    policy->accessed(frameNo);
+  }
+
+  // wait for another thread still reading the page in
+  if (desc.loading)
+  {
+    std::lock_guard<std::mutex> wait(desc.latch);
+  }
+  if (!desc.valid)
+  {
+    // that read failed
+    desc.pinCnt--;
+    return false;
+  }
 
-    // is valid, check referenced bit
-    if (! bufDescTable[clockHand].refbit)
+  page = &bufPool[frameNo];
+  return true;
+}
+
+void BufMgr::readPage(File* file, const PageId pageNo, Page*& page, BufRing* ring)
+{
+  bufStats.accesses++;
+  loadPage(file, pageNo, page, ring, false);
+}
+
+void BufMgr::loadPage(File* file, const PageId pageNo, Page*& page, BufRing* ring, const bool prefetched)
+{
+  BufHashPartition& partition = hashPartition(file, pageNo);
+  while (!pinPage(file, pageNo, page, !prefetched))
+  {
+    //not in the buffer pool, must allocate a new page
+    // alloc a new frame
+    FrameId frameNo;
+    if (ring == NULL)
+      allocBuf(frameNo);
+    else
     {
-      // check to see if someone has it pinned
-      if (bufDescTable[clockHand].pinCnt == 0)
+      // the scan and its read-ahead requests take frames of the ring in turn
+      std::lock_guard<std::mutex> guard(ring->lock);
+      if (!claimRingFrame(*ring, frameNo))
+        allocBuf(frameNo);
+      ring->add(frameNo, file, pageNo);
+    }
+    policy->loaded(frameNo, file, pageNo);
+    BufDesc& desc = bufDescTable[frameNo];
+    std::unique_lock<std::mutex> latch(desc.latch);
+
+    // set up the entry properly, and publish it before reading so that other
+    // threads asking for the page wait for this read instead of starting their own
+    desc.Set(file, pageNo);
+    desc.loading = true;
+    // a page read through a ring is expected to be used once
+    if (ring != NULL)
+      desc.refbit = false;
+    desc.prefetched = prefetched;
+    bool found;
+    {
+      std::lock_guard<std::mutex> guard(partition.lock);
+      FrameId otherFrameNo;
+      found = partition.table->tryLookup(file, pageNo, otherFrameNo);
+      if (!found)
       {
-        // hasn't been referenced and is not pinned, use it
-        // remove previous entry from hash table
-        hashTable->remove(bufDescTable[clockHand].file, bufDescTable[clockHand].pageNo);
-        found = true;
-        break;
+        // insert in the hash table
+        partition.table->insert(file, pageNo, frameNo);
       }
     }
-    else
+    if (found)
     {
-      // has been referenced, clear the bit
-      bufStats.accesses++;
-      bufDescTable[clockHand].refbit = false;
+      // another thread got there first
+      latch.unlock();
+      policy->removed(frameNo);
+      desc.Clear();
+      continue;
     }
+
+    // read the page into the new frame
+    try
+    {
+      file->readPage(pageNo, bufPool[frameNo]);
+    }
+    catch (...)
+    {
+      {
+        std::lock_guard<std::mutex> guard(partition.lock);
+        partition.table->remove(file, pageNo);
+        // threads waiting for the read may still have the frame pinned, so it is not cleared, but it
+        // must no longer look like a frame of the file to flushFile
+        desc.file = NULL;
+        desc.pageNo = Page::INVALID_NUMBER;
+        desc.valid = false;
+        desc.loading = false;
+      }
+      // the list policies claim frames, which takes partition locks, while holding their own lock
+      policy->removed(frameNo);
+      desc.pinCnt--;
+      throw;
+    }
+    bufStats.diskreads++;
+    desc.loading = false;
+    page = &bufPool[frameNo];
+    return;
   }
-  
-  // check for full buffer pool
-  if (!found && numScanned >= 2*numBufs)
+}
+
+
+void BufMgr::prefetchPage(File* file, const PageId pageNo, BufRing* ring)
+{
+  if (pageNo == Page::INVALID_NUMBER)
+    return;
+
+  // nothing to do for a page that is there already
+  FrameId frameNo;
+  BufHashPartition& partition = hashPartition(file, pageNo);
   {
-    throw BufferExceededException();
+    std::lock_guard<std::mutex> guard(partition.lock);
+    if (partition.table->tryLookup(file, pageNo, frameNo))
+      return;
   }
-  
-  // flush any existing changes to disk if necessary
-  if (bufDescTable[clockHand].dirty)
+
+  PrefetchRequest request = { file, pageNo, 1, ring };
+  queuePrefetch(request);
+}
+
+void BufMgr::prefetchChain(PageFile* file, const PageId pageNo, const std::uint32_t numPages, BufRing* ring)
+{
+  if (pageNo == Page::INVALID_NUMBER || numPages == 0)
+    return;
+
+  // the pages following the first are only known once it is read
+  PrefetchRequest request = { file, pageNo, numPages, ring };
+  queuePrefetch(request);
+}
+
+void BufMgr::queuePrefetch(const PrefetchRequest& request)
+{
   {
-    bufStats.diskwrites++;
-    //status = bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo,
-    bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo, bufPool[clockHand]);
+    std::lock_guard<std::mutex> guard(prefetchMutex);
+    if (prefetchStopping || prefetchQueue.size() >= std::max(numBufs / 4, 1u))
+      return;
+
+    if (prefetchThreads.empty())
+    {
+      for (std::uint32_t i = 0; i < PREFETCHTHREADS; i++)
+        prefetchThreads.push_back(std::thread(&BufMgr::prefetchWorker, this));
+    }
+    prefetchQueue.push_back(request);
+    prefetchPending[request.file]++;
   }
+  prefetchReady.notify_one();
+}
 
-	//Reset all the BufDesc entry for the frame before returning the frame
-  bufDescTable[clockHand].Clear();
+void BufMgr::prefetchWorker()
+{
+  std::unique_lock<std::mutex> guard(prefetchMutex);
+  while (true)
+  {
+    while (!prefetchStopping && prefetchQueue.empty())
+      prefetchReady.wait(guard);
+    if (prefetchStopping)
+      return;
+
+    PrefetchRequest request = prefetchQueue.front();
+    prefetchQueue.pop_front();
+    guard.unlock();
+
+    // a request is only a hint, so pages that cannot be read are skipped
+    PageId nextPageNo = Page::INVALID_NUMBER;
+    try
+    {
+      Page* page;
+      if (!pinPage(request.file, request.pageNo, page, false))
+        loadPage(request.file, request.pageNo, page, request.ring, true);
+      if (request.remaining > 1)
+        nextPageNo = page->next_page_number();
+      unPinPage(request.file, request.pageNo, false);
+    }
+    catch (...)
+    {
+      nextPageNo = Page::INVALID_NUMBER;
+    }
 
-  // return new frame number
-  frame = clockHand;
-} // end allocBuf
+    guard.lock();
+    if (nextPageNo != Page::INVALID_NUMBER && !prefetchStopping)
+    {
+      // carry on down the chain, ahead of requests made since
+      request.pageNo = nextPageNo;
+      request.remaining--;
+      prefetchQueue.push_front(request);
+      prefetchReady.notify_one();
+    }
+    else if (--prefetchPending[request.file] == 0)
+    {
+      prefetchPending.erase(request.file);
+      prefetchDone.notify_all();
+    }
+  }
+}
 
-	
-void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
+void BufMgr::backgroundWriter()
 {
-  // check to see if it is already in the buffer pool
-  // std::cout << "readPage called on file.page " << file << "." << pageNo << endl;
-  FrameId frameNo = 0;
-	try
-	{
-  	hashTable->lookup(file, pageNo, frameNo);
-
-    // set the referenced bit
-    bufDescTable[frameNo].refbit = true;
-    bufDescTable[frameNo].pinCnt++;
-    page = &bufPool[frameNo];
+  std::unique_lock<std::mutex> guard(writerMutex);
+  while (!writerStopping)
+  {
+    writeDirtyPages(BUFWRITERBATCH);
+    writerWake.wait_for(guard, std::chrono::milliseconds(BUFWRITERINTERVAL));
   }
-  catch(const HashNotFoundException &e) //not in the buffer pool, must allocate a new page
+}
+
+std::uint32_t BufMgr::writeDirtyPages(const std::uint32_t maxPages)
+{
+  // pin unpinned dirty pages, carrying on from where the last pass stopped
+  std::vector<FrameId> frames;
+  for (std::uint32_t n = 0; n < numBufs && frames.size() < maxPages; n++)
   {
-    // alloc a new frame
-    allocBuf(frameNo);
+    const FrameId frameNo = writerCursor;
+    writerCursor = (writerCursor + 1) % numBufs;
+    BufDesc& desc = bufDescTable[frameNo];
+    int unpinned = 0;
+    if (!desc.dirty || !desc.pinCnt.compare_exchange_strong(unpinned, 1))
+      continue;
+    if (!desc.valid || !desc.dirty)
+    {
+      desc.pinCnt--;
+      continue;
+    }
+    frames.push_back(frameNo);
+  }
 
-    // read the page into the new frame
-    bufStats.diskreads++;
-    //status = file->readPage(pageNo, &bufPool[frameNo]);
-    bufPool[frameNo] = file->readPage(pageNo);
+  std::sort(frames.begin(), frames.end(), [this](const FrameId a, const FrameId b)
+  {
+    const BufDesc& descA = bufDescTable[a];
+    const BufDesc& descB = bufDescTable[b];
+    if (descA.file != descB.file)
+      return descA.file < descB.file;
+    return descA.pageNo < descB.pageNo;
+  });
+
+  // copy the pages, so that they can be requested and changed again while the copies are
+  // written. Requests wait for the copy, and a request that pinned the page before loading
+  // was set is seen here, in which case the page is left alone.
+  std::vector<FrameId> copied;
+  std::vector<Page> copies;
+  copies.reserve(frames.size());
+  for (std::size_t i = 0; i < frames.size(); i++)
+  {
+    BufDesc& desc = bufDescTable[frames[i]];
+    {
+      std::lock_guard<std::mutex> latch(desc.latch);
+      desc.loading = true;
+      if (desc.pinCnt == 1)
+      {
+        desc.dirty = false;
+        copies.push_back(bufPool[frames[i]]);
+        copied.push_back(frames[i]);
+      }
+      desc.loading = false;
+    }
+    if (copied.empty() || copied.back() != frames[i])
+      desc.pinCnt--;
+  }
 
-    // set up the entry properly
-    bufDescTable[frameNo].Set(file, pageNo);
-    page = &bufPool[frameNo];
+  // write runs of consecutive pages of a file together. The frames stay pinned until then,
+  // so that they are not replaced before their pages are on disk.
+  std::uint32_t numWritten = 0;
+  for (std::size_t first = 0; first < copied.size(); )
+  {
+    File* file = bufDescTable[copied[first]].file;
+    const PageId firstPageNo = bufDescTable[copied[first]].pageNo;
+    std::size_t last = first + 1;
+    while (last < copied.size() && bufDescTable[copied[last]].file == file &&
+           bufDescTable[copied[last]].pageNo == firstPageNo + (last - first))
+      last++;
+
+    try
+    {
+      file->writePages(firstPageNo, &copies[first], last - first);
+      bufStats.diskwrites += last - first;
+      numWritten += last - first;
+    }
+    catch (...)
+    {
+      // leave the pages for the thread replacing them, which reports the failure
+      for (std::size_t i = first; i < last; i++)
+        bufDescTable[copied[i]].dirty = true;
+    }
 
-    // insert in the hash table
-    hashTable->insert(file, pageNo, frameNo);
+    for (std::size_t i = first; i < last; i++)
+      bufDescTable[copied[i]].pinCnt--;
+    first = last;
   }
+  return numWritten;
 }
 
+void BufMgr::cancelPrefetches(const File* file)
+{
+  std::unique_lock<std::mutex> guard(prefetchMutex);
+  for (std::deque<PrefetchRequest>::iterator it = prefetchQueue.begin(); it != prefetchQueue.end(); )
+  {
+    if (it->file == file)
+    {
+      it = prefetchQueue.erase(it);
+      prefetchPending[file]--;
+    }
+    else
+      it++;
+  }
+  if (prefetchPending.count(file) > 0 && prefetchPending[file] == 0)
+    prefetchPending.erase(file);
+
+  while (prefetchPending.count(file) > 0)
+    prefetchDone.wait(guard);
+}
 
 void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty) 
 {
   // lookup in hashtable
   FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
+  BufHashPartition& partition = hashPartition(file, pageNo);
+  {
+    std::lock_guard<std::mutex> guard(partition.lock);
+    partition.table->lookup(file, pageNo, frameNo);
+  }
 
-  if (dirty == true) bufDescTable[frameNo].dirty = dirty;
+  if (dirty == true)
+  {
+    bufDescTable[frameNo].dirty = dirty;
+    std::call_once(writerStarted, [this]() { writerThread = std::thread(&BufMgr::backgroundWriter, this); });
+  }
 
   // make sure the page is actually pinned
-  if (bufDescTable[frameNo].pinCnt == 0)
+  int pinCnt = bufDescTable[frameNo].pinCnt;
+  do
   {
-  	throw PageNotPinnedException(file->filename(), pageNo, frameNo);
-  }
-  else bufDescTable[frameNo].pinCnt--;
+    if (pinCnt == 0)
+    {
+  	  throw PageNotPinnedException(file->filename(), pageNo, frameNo);
+    }
+  } while (!bufDescTable[frameNo].pinCnt.compare_exchange_weak(pinCnt, pinCnt - 1));
 }
 
 void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page) 
@@ -176,35 +574,56 @@ void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page)
   allocBuf(frameNo);
 
   // allocate a new page in the file
-	//std::cerr << "buffer data size:" << bufPool[frameNo].data_.length() << "\n";
-  bufPool[frameNo] = file->allocatePage(pageNo);
+  try
+  {
+    file->allocatePage(pageNo, bufPool[frameNo]);
+  }
+  catch (...)
+  {
+    policy->removed(frameNo);
+    bufDescTable[frameNo].pinCnt--;
+    throw;
+  }
   page = &bufPool[frameNo];
+  bufStats.accesses++;
+  bufStats.diskreads++;
 
   // set up the entry properly
   bufDescTable[frameNo].Set(file, pageNo);
+  policy->loaded(frameNo, file, pageNo);
 
   // insert in the hash table
-  hashTable->insert(file, pageNo, frameNo);
+  BufHashPartition& partition = hashPartition(file, pageNo);
+  std::lock_guard<std::mutex> guard(partition.lock);
+  partition.table->insert(file, pageNo, frameNo);
 }
 
 void BufMgr::flushFile(const File* file) 
 {
+  cancelPrefetches(file);
+  std::lock_guard<std::mutex> writing(writerMutex);
+
   for (std::uint32_t i = 0; i < numBufs; i++)
 	{
   	BufDesc* tmpbuf = &(bufDescTable[i]);
   	if(tmpbuf->file && tmpbuf->valid == true && tmpbuf->file == file)
 		{
-	    if (tmpbuf->pinCnt > 0)
+      // pin the frame so that it is not evicted while it is written
+      int unpinned = 0;
+	    if (!tmpbuf->pinCnt.compare_exchange_strong(unpinned, 1))
   			throw PagePinnedException(file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
 
-	    if (tmpbuf->dirty == true)
+	    if (tmpbuf->dirty.exchange(false))
 			{
-				//if ((status = tmpbuf->file->writePage(tmpbuf->pageNo, &(bufPool[i]))) != OK)
-				tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
-				tmpbuf->dirty = false;
+				tmpbuf->file.load()->writePage(tmpbuf->pageNo, bufPool[i]);
     	}
 
-    	hashTable->remove(file,tmpbuf->pageNo);
+      BufHashPartition& partition = hashPartition(file, tmpbuf->pageNo);
+      {
+        std::lock_guard<std::mutex> guard(partition.lock);
+    	  partition.table->remove(file,tmpbuf->pageNo);
+      }
+      policy->removed(i);
     	tmpbuf->Clear();
   	}
 		else if (tmpbuf->valid == false && tmpbuf->file == file)
@@ -215,14 +634,25 @@ void BufMgr::flushFile(const File* file)
 void BufMgr::disposePage(File* file, const PageId pageNo)
 {
 	//Deallocate from file altogether
-  //See if it is in the buffer pool
+  //See if it is in the buffer pool, making sure read-ahead is not reading it in
+  cancelPrefetches(file);
+  std::lock_guard<std::mutex> writing(writerMutex);
   FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
+  bool found;
+  BufHashPartition& partition = hashPartition(file, pageNo);
+  {
+    std::lock_guard<std::mutex> guard(partition.lock);
+    found = partition.table->tryLookup(file, pageNo, frameNo);
+    if (found)
+      partition.table->remove(file, pageNo);
+  }
 
 	// clear the page
-	bufDescTable[frameNo].Clear();
-
-	hashTable->remove(file, pageNo);
+  if (found)
+  {
+    policy->removed(frameNo);
+	  bufDescTable[frameNo].Clear();
+  }
 
   // deallocate it in the file	
   file->deletePage(pageNo);
@@ -9,7 +9,16 @@
 
 #include "file.h"
 #include "bufHashTbl.h"
+#include "bufPolicy.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace badgerdb {
 
@@ -20,21 +29,27 @@ class BufMgr;
 
 /**
 * @brief Class for maintaining information about buffer pool frames
+*
+* The members are atomic so that threads can test and pin frames without a lock. A thread that
+* pins a frame whose pin count was zero owns it, and only the owner of a frame changes the page
+* it is assigned to.
 */
 class BufDesc {
 
 	friend class BufMgr;
+	friend class ClockPolicy;
+	friend class ListPolicy;
 
  private:
 	/**
    * Pointer to file to which corresponding frame is assigned
 	 */
-  File* file;
+  std::atomic<File*> file;
 
 	/**
    * Page within file to which corresponding frame is assigned
 	 */
-  PageId pageNo;
+  std::atomic<PageId> pageNo;
 
 	/**
    * Frame number of the frame, in the buffer pool, being used
@@ -44,34 +59,54 @@ class BufDesc {
 	/**
    * Number of times this page has been pinned
 	 */
-  int pinCnt;
+  std::atomic<int> pinCnt;
 
 	/**
    * True if page is dirty;  false otherwise
 	 */
-  bool dirty;
+  std::atomic<bool> dirty;
 
 	/**
    * True if page is valid
 	 */
-  bool valid;
+  std::atomic<bool> valid;
 
 	/**
    * Has this buffer frame been reference recently
 	 */
-  bool refbit;
+  std::atomic<bool> refbit;
 
 	/**
-   * Initialize buffer frame for a new user
+   * True while the page is being read into the frame. Threads that find the page in the hash
+   * table in this state wait on latch until the read is done.
+	 */
+  std::atomic<bool> loading;
+
+	/**
+   * True if the page was read ahead and has not been requested since. The first request counts as the
+   * page being read in rather than as a repeated access.
+	 */
+  std::atomic<bool> prefetched;
+
+	/**
+   * Latch held by the owner of the frame while the page is read into it or written out from it
+	 */
+  std::mutex latch;
+
+	/**
+   * Initialize buffer frame for a new user. The pin count is cleared last, as that hands the
+   * frame over to other threads.
 	 */
   void Clear()
 	{
-    pinCnt = 0;
 		file = NULL;
 		pageNo = Page::INVALID_NUMBER;
     dirty = false;
     refbit = false;
 		valid = false;
+		loading = false;
+		prefetched = false;
+    pinCnt = 0;
   };
 
 	/**
@@ -89,13 +124,15 @@ class BufDesc {
     dirty = false;
     valid = true;
     refbit = true;
+		loading = false;
+		prefetched = false;
   }
 
   void Print()
 	{
 		if(file != NULL)
 		{
-			std::cout << "file:" << file->filename() << " ";
+			std::cout << "file:" << file.load()->filename() << " ";
 			std::cout << "pageNo:" << pageNo << " ";
 		}
 		else
@@ -125,17 +162,17 @@ struct BufStats
 	/**
    * Total number of accesses to buffer pool
 	 */
-  int accesses;
+  std::atomic<int> accesses;
 
 	/**
    * Number of pages read from disk (including allocs)
 	 */
-  int diskreads;
+  std::atomic<int> diskreads;
 
 	/**
    * Number of pages written back to disk
 	 */
-  int diskwrites;
+  std::atomic<int> diskwrites;
 
 	/**
    * Clear all values 
@@ -156,25 +193,146 @@ struct BufStats
 
 
 /**
-* @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file 
+ * @brief Default number of frames in the ring of a sequential scan.
+ */
+const std::uint32_t BUFRINGSIZE = 16;
+
+/**
+* @brief A small set of frames that a sequential scan reads its pages into, reusing them in turn
+*
+* Once the ring is full, a page missing from the buffer pool is read into the ring frame used longest ago,
+* provided the frame is unpinned and still holds the page the scan put there. The pages of a large scan
+* therefore replace each other instead of the rest of the pool. A ring belongs to a single scan, and is
+* only shared with the read-ahead requests the scan makes.
 */
-class BufMgr 
+class BufRing
 {
+	friend class BufMgr;
+
  private:
 	/**
-   * Current position of clockhand in our buffer pool
+   * A frame of the ring and the page the scan read into it
 	 */
-  FrameId clockHand;
+	struct Entry
+	{
+		FrameId frameNo;
+		const File* file;
+		PageId pageNo;
+	};
 
+	/**
+   * Largest number of frames in the ring
+	 */
+	std::uint32_t capacity;
+
+	/**
+   * Frames of the ring
+	 */
+	std::vector<Entry> entries;
+
+	/**
+   * Entry to be reused next once the ring is full
+	 */
+	std::uint32_t next;
+
+	/**
+   * Held while a frame of the ring is taken and recorded
+	 */
+	std::mutex lock;
+
+	/**
+   * Record that the page was read into the frame, in place of the entry reused next if the ring is full
+	 */
+	void add(const FrameId frameNo, const File* file, const PageId pageNo);
+
+ public:
+	/**
+   * Constructor of BufRing class
+   *
+   * @param size		Largest number of frames in the ring
+	 */
+	BufRing(const std::uint32_t size = BUFRINGSIZE)
+		: capacity(size), next(0)
+	{
+		entries.reserve(size);
+	}
+};
+
+
+/**
+ * @brief Number of threads reading pages ahead of scans.
+ */
+const std::uint32_t PREFETCHTHREADS = 4;
+
+/**
+ * @brief Default number of pages a scan asks to be read ahead of the page it is on.
+ */
+const std::uint32_t PREFETCHDEPTH = 8;
+
+
+/**
+ * @brief Milliseconds the background writer waits between passes over the buffer pool.
+ */
+const std::uint32_t BUFWRITERINTERVAL = 10;
+
+/**
+ * @brief Largest number of dirty pages the background writer writes in a pass.
+ */
+const std::uint32_t BUFWRITERBATCH = 64;
+
+
+/**
+ * @brief Number of partitions of the buffer hash table.
+ */
+const std::uint32_t BUFHASHPARTITIONS = 16;
+
+/**
+* @brief A partition of the buffer hash table and the lock that guards it
+*/
+struct BufHashPartition
+{
+	/**
+   * Held while the table is searched or changed, and while a frame found in it is pinned
+	 */
+  std::mutex lock;
+
+	/**
+   * Hash table mapping the (File, page) pairs of this partition to frames
+	 */
+  BufHashTbl *table;
+};
+
+
+/**
+* @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file 
+*
+* The buffer manager may be used from several threads at once. A page is found through one of
+* BUFHASHPARTITIONS independently locked partitions of the hash table, pinning is done with atomic
+* operations on the frame's descriptor, and with the CLOCK policy threads sweep the clock without a shared lock. Files are
+* read and written without a lock of the buffer manager, as pages are read and written at their own offsets. Access to the contents of a pinned
+* page is not synchronized: threads that change a page must coordinate among themselves.
+*
+* Pages can be asked to be read ahead, which is done by a pool of PREFETCHTHREADS threads started on the
+* first such request. Requests are only hints: they are dropped when the queue is long, and a page that
+* cannot be read is skipped.
+*
+* Dirty pages are written back by a background thread, started when a page is first unpinned dirty, so
+* that frames are mostly clean by the time they are replaced. Each pass writes up to BUFWRITERBATCH
+* unpinned dirty pages, sorted so that consecutive pages of a file are written together. The pages are
+* copied before they are written, so requests for them only wait for the copy.
+*/
+class BufMgr 
+{
+ private:
 	/**
    * Number of frames in the buffer pool
 	 */
   std::uint32_t numBufs;
 	
 	/**
-   * Hash table mapping (File, page) to frame
+   * Partitions of the hash table mapping (File, page) to frame
 	 */
-  BufHashTbl *hashTable;
+  BufHashPartition *hashPartitions;
 
 	/**
    * Array of BufDesc objects to hold information corresponding to every frame allocation from 'bufPool' (the buffer pool)
@@ -187,21 +345,167 @@ class BufMgr
   BufStats bufStats;
 
 	/**
-   * Advance clock to next frame in the buffer pool
+   * Chooses the frames that pages are read into
+	 */
+  BufPolicy *policy;
+
+	/**
+   * A request to read ahead the page pageNo of file and, if remaining is more than one, the pages following it
 	 */
-  void advanceClock()
+	struct PrefetchRequest
+	{
+		File* file;
+		PageId pageNo;
+		std::uint32_t remaining;
+		BufRing* ring;
+	};
+
+	/**
+   * Held while the read-ahead queue and counts are used
+	 */
+  std::mutex prefetchMutex;
+
+	/**
+   * Signalled when a request is queued, and when a file has no requests left
+	 */
+  std::condition_variable prefetchReady, prefetchDone;
+
+	/**
+   * Requests not yet taken by a thread
+	 */
+  std::deque<PrefetchRequest> prefetchQueue;
+
+	/**
+   * Number of requests queued or being done for each file
+	 */
+  std::map<const File*, int> prefetchPending;
+
+	/**
+   * Threads doing the requests, started on the first one
+	 */
+  std::vector<std::thread> prefetchThreads;
+
+	/**
+   * Set when the threads are to finish
+	 */
+  bool prefetchStopping;
+
+	/**
+   * Held by the background writer during a pass, and by those who must not find its pins on frames
+	 */
+  std::mutex writerMutex;
+
+	/**
+   * Signalled to wake the background writer early
+	 */
+  std::condition_variable writerWake;
+
+	/**
+   * Background writer, and the flag starting it once
+	 */
+  std::thread writerThread;
+  std::once_flag writerStarted;
+
+	/**
+   * Set when the background writer is to finish. Guarded by writerMutex.
+	 */
+  bool writerStopping;
+
+	/**
+   * Frame the next pass of the background writer starts at. Guarded by writerMutex.
+	 */
+  FrameId writerCursor;
+
+	/**
+   * Body of the background writer
+	 */
+  void backgroundWriter();
+
+	/**
+   * Write out up to maxPages unpinned dirty pages, consecutive pages of a file together. Called with
+   * writerMutex held.
+   *
+   * @param maxPages	Largest number of pages to write
+   * @return					Number of pages written
+	 */
+  std::uint32_t writeDirtyPages(const std::uint32_t maxPages);
+
+	/**
+   * Queue a read-ahead request, unless the queue is full.
+	 */
+  void queuePrefetch(const PrefetchRequest& request);
+
+	/**
+   * Body of the read-ahead threads
+	 */
+  void prefetchWorker();
+
+	/**
+   * Drop the queued read-ahead requests for the file and wait for those being done, so that none of its pages
+   * is pinned by a read-ahead thread on return.
+	 */
+  void cancelPrefetches(const File* file);
+
+	/**
+   * Partition of the hash table holding (file, pageNo)
+	 */
+  BufHashPartition& hashPartition(const File* file, const PageId pageNo)
   {
-		clockHand = (clockHand + 1) % numBufs;
+		return hashPartitions[(BufHashTbl::hash(file, pageNo) >> 32) % BUFHASHPARTITIONS];
   }
 
 	/**
 	 * Allocate a free frame.  
 	 *
-	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
+	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable. The frame is pinned once
+	 *									by the caller and not assigned to any page.
 	 * @throws BufferExceededException If no such buffer is found which can be allocated
 	 */
   void allocBuf(FrameId & frame);
 
+	/**
+	 * Take the frame for a new page if it is not pinned. A page held by the frame is written back if dirty
+	 * and then dropped from the hash table.
+	 *
+	 * @param frameNo  	Frame number
+	 * @param expectedFile   	If not NULL, the frame is only taken if it holds page expectedPageNo of this file
+	 * @param expectedPageNo  Page number in the file
+	 * @return					True if the frame was taken, in which case it is pinned once and not assigned to any page
+	 */
+  bool claimFrame(const FrameId frameNo, const File* expectedFile = NULL, const PageId expectedPageNo = Page::INVALID_NUMBER);
+
+	/**
+	 * Take the next frame of a full ring for a new page, if it is unpinned and still holds the page the scan
+	 * read into it.
+	 *
+	 * @param ring   		Ring of the scan
+	 * @param frameNo  	Set to the frame taken
+	 * @return					True if the frame was taken, in which case it is pinned once and not assigned to any page
+	 */
+  bool claimRingFrame(BufRing& ring, FrameId& frameNo);
+
+	/**
+	 * Pins the page if it is present in the buffer pool.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file
+	 * @param page  	Set to the frame holding the page if it is found
+	 * @param access	True if the page is requested by a user of the buffer pool, rather than looked at by read-ahead
+	 * @return				True if the page was found and pinned
+	 */
+  bool pinPage(File* file, const PageId PageNo, Page*& page, const bool access);
+
+	/**
+	 * Reads the page into the buffer pool unless it is there already, and pins it.
+	 *
+	 * @param file   			File object
+	 * @param PageNo  		Page number in the file
+	 * @param page  			Set to the frame holding the page
+	 * @param ring  			If not NULL, the page is read into a frame of this ring
+	 * @param prefetched	True if the page is read ahead
+	 */
+  void loadPage(File* file, const PageId PageNo, Page*& page, BufRing* ring, const bool prefetched);
+
  public:
 	/**
    * Actual buffer pool from which frames are allocated
@@ -210,8 +514,11 @@ class BufMgr
 
 	/**
    * Constructor of BufMgr class
+   *
+   * @param bufs  						Number of frames in the buffer pool
+   * @param replacementPolicy	Policy choosing the frames that pages are read into
 	 */
-  BufMgr(std::uint32_t bufs);
+  BufMgr(std::uint32_t bufs, const ReplacementPolicy replacementPolicy = CLOCK);
 	
 	/**
    * Destructor of BufMgr class
@@ -226,8 +533,41 @@ class BufMgr
 	 * @param file   	File object
 	 * @param PageNo  Page number in the file to be read
 	 * @param page  	Reference to page pointer. Used to fetch the Page object in which requested page from file is read in.
+	 * @param ring  	If not NULL, the page is read into a frame of this ring rather than one chosen by the replacement policy
+	 */
+  void readPage(File* file, const PageId PageNo, Page*& page, BufRing* ring = NULL);
+
+	/**
+	 * Pins the given page and returns the pointer to it if the page is present in the buffer pool. The page is not
+	 * read from the file otherwise, and no exception is thrown.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file
+	 * @param page  	Reference to page pointer. Set to the frame holding the page if it is found.
+	 * @return				True if the page was found and pinned
+	 */
+  bool tryReadPage(File* file, const PageId PageNo, Page*& page);
+
+	/**
+	 * Asks for the page to be read into the buffer pool in the background, if it is not there already. The page
+	 * is left unpinned. Nothing is done for Page::INVALID_NUMBER.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file
+	 * @param ring  	If not NULL, the page is read into a frame of this ring
+	 */
+  void prefetchPage(File* file, const PageId PageNo, BufRing* ring = NULL);
+
+	/**
+	 * Asks for the page and the pages following it in the file's chain of used pages to be read into the buffer
+	 * pool in the background. The pages are left unpinned.
+	 *
+	 * @param file   		File object
+	 * @param PageNo  	Page number of the first page
+	 * @param numPages  Number of pages to read ahead
+	 * @param ring  		If not NULL, the pages are read into frames of this ring
 	 */
-  void readPage(File* file, const PageId PageNo, Page*& page);
+  void prefetchChain(PageFile* file, const PageId PageNo, const std::uint32_t numPages, BufRing* ring = NULL);
 
 	/**
 	 * Unpin a page from memory since it is no longer required for it to remain in memory.
@@ -252,7 +592,7 @@ class BufMgr
 	/**
 	 * Writes out all dirty pages of the file to disk.
 	 * All the frames assigned to the file need to be unpinned from buffer pool before this function can be successfully called.
-	 * Otherwise Error returned.
+	 * Otherwise Error returned. Pending read-ahead requests for the file are dropped first.
 	 *
 	 * @param file   	File object
    * @throws  PagePinnedException If any page of the file is pinned in the buffer pool 
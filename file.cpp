@@ -7,6 +7,15 @@
 
 #include "file.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <memory>
@@ -14,7 +23,9 @@
 #include <cstdio>
 #include <cassert>
 
+#include "exceptions/bad_file_format_exception.h"
 #include "exceptions/file_exists_exception.h"
+#include "exceptions/file_io_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/file_open_exception.h"
 #include "exceptions/invalid_page_exception.h"
@@ -23,8 +34,53 @@
 
 namespace badgerdb {
 
-File::StreamMap File::open_streams_;
+File::DescriptorMap File::open_descriptors_;
 File::CountMap File::open_counts_;
+File::LockMap File::open_locks_;
+File::PageSetMap File::open_free_pages_;
+File::PageLinkTableMap File::open_page_links_;
+bool File::direct_io_ = false;
+bool File::memory_mapped_ = false;
+
+static_assert(sizeof(Page) == Page::SIZE,
+              "Pages are read and written from memory as a whole.");
+
+namespace {
+
+/**
+ * Page-aligned memory, which O_DIRECT reads and writes need.
+ */
+class AlignedBuffer {
+ public:
+  explicit AlignedBuffer(const std::size_t size) : data_(NULL) {
+    if (posix_memalign(&data_, Page::SIZE, size) != 0) {
+      throw std::bad_alloc();
+    }
+    std::memset(data_, 0, size);
+  }
+  ~AlignedBuffer() { std::free(data_); }
+  char* data() const { return static_cast<char*>(data_); }
+
+ private:
+  void* data_;
+};
+
+/**
+ * True if O_DIRECT can read or write the bytes in place.
+ */
+bool isAligned(const void* buffer, const std::size_t size,
+               const std::int64_t position) {
+  return reinterpret_cast<std::uintptr_t>(buffer) % Page::SIZE == 0 &&
+         size % Page::SIZE == 0 && position % Page::SIZE == 0;
+}
+
+/**
+ * Smallest mapping made of a file, so that small files can grow for a while
+ * before they are mapped again.
+ */
+const std::int64_t MIN_MAPPING_LENGTH = 64 * Page::SIZE;
+
+}
 
 void File::remove(const std::string& filename) {
   if (!exists(filename)) {
@@ -64,24 +120,39 @@ PageId File::getFirstPageNo() {
   return header.first_used_page;
 }
 
+PageId File::getNumPages() const {
+  return readHeader().num_pages;
+}
+
 File::File(const std::string& name, const bool create_new) : filename_(name) {
   openIfNeeded(create_new);
 
   if (create_new) {
     // File starts with 1 page (the header).
-    FileHeader header = {1 /* num_pages */, 0 /* first_used_page */,
-                         0 /* num_free_pages */, 0 /* first_free_page */};
+    FileHeader header = {FILEMAGIC, FILEVERSION,
+                         1 /* num_pages */, 0 /* first_used_page */,
+                         0 /* num_free_pages */, 0 /* first_free_page */,
+                         0 /* last_used_page */};
     writeHeader(header);
+  } else {
+    // Files of another layout would be misread rather than fail.
+    const FileHeader header = readHeader();
+    if (header.magic != FILEMAGIC || header.version != FILEVERSION) {
+      close();
+      throw BadFileFormatException(filename_);
+    }
   }
 }
 
 void File::openIfNeeded(const bool create_new) {
   if (open_counts_.find(filename_) != open_counts_.end()) {	//exists an entry already
     ++open_counts_[filename_];
-    stream_ = open_streams_[filename_];
+    descriptor_ = open_descriptors_[filename_];
+    update_lock_ = open_locks_[filename_];
+    free_pages_ = open_free_pages_[filename_];
+    page_links_ = open_page_links_[filename_];
   } else {
-    std::ios_base::openmode mode =
-        std::fstream::in | std::fstream::out | std::fstream::binary;
+    int flags = O_RDWR;
     const bool already_exists = exists(filename_);
     if (create_new) {
       // Error if we try to overwrite an existing file.
@@ -89,15 +160,45 @@ void File::openIfNeeded(const bool create_new) {
         throw FileExistsException(filename_);
       }
       // New files have to be truncated on open.
-      mode = mode | std::fstream::trunc;
+      flags = flags | O_CREAT | O_TRUNC;
     } else {
       // Error if we try to open a file that doesn't exist.
       if (!already_exists) {
         throw FileNotFoundException(filename_);
       }
     }
-    stream_.reset(new std::fstream(filename_, mode));
-    open_streams_[filename_] = stream_;
+    int fd = -1;
+    bool direct = false;
+#ifdef O_DIRECT
+    if (direct_io_) {
+      // Not every filesystem supports O_DIRECT.
+      fd = ::open(filename_.c_str(), flags | O_DIRECT, 0666);
+      direct = fd >= 0;
+    }
+#endif
+    if (fd < 0) {
+      fd = ::open(filename_.c_str(), flags, 0666);
+    }
+    if (fd < 0) {
+      throw FileIOException(filename_, errno);
+    }
+    descriptor_.reset(new Descriptor(fd, direct));
+    if (memory_mapped_ && !direct) {
+      // Files that cannot be mapped are read with pread instead.
+      struct stat status;
+      if (::fstat(fd, &status) == 0) {
+        std::lock_guard<std::mutex> guard(descriptor_->mapping_lock);
+        descriptor_->size = status.st_size;
+        descriptor_->map(2 * status.st_size);
+      }
+    }
+    open_descriptors_[filename_] = descriptor_;
+    update_lock_.reset(new std::mutex);
+    open_locks_[filename_] = update_lock_;
+    free_pages_.reset(new std::set<PageId>);
+    open_free_pages_[filename_] = free_pages_;
+    page_links_.reset(new PageLinkTable);
+    open_page_links_[filename_] = page_links_;
     open_counts_[filename_] = 1;
   }
 }
@@ -106,26 +207,226 @@ void File::close() {
 	if(open_counts_[filename_] > 0)
   	--open_counts_[filename_];
 
-  stream_.reset();
+  descriptor_.reset();
+  update_lock_.reset();
+  free_pages_.reset();
+  page_links_.reset();
 	assert(open_counts_[filename_] >= 0);
 
   if (open_counts_[filename_] == 0) {
-    open_streams_.erase(filename_);
+    open_descriptors_.erase(filename_);
     open_counts_.erase(filename_);
+    open_locks_.erase(filename_);
+    open_free_pages_.erase(filename_);
+    open_page_links_.erase(filename_);
   }
 }
 
 FileHeader File::readHeader() const {
   FileHeader header;
-  stream_->seekg(0 /* pos */, std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
+  readAt(&header, sizeof(FileHeader), 0 /* pos */);
   return header;
 }
 
 void File::writeHeader(const FileHeader& header) {
-  stream_->seekp(0 /* pos */, std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
-  stream_->flush();
+  writeAt(&header, sizeof(FileHeader), 0 /* pos */);
+}
+
+void File::readAt(void* buffer, const std::size_t size,
+                  const std::int64_t position) const {
+  const Mapping* mapping = descriptor_->mapping.load();
+  if (mapping != NULL && position + (std::int64_t)size <= descriptor_->size &&
+      position + size <= mapping->length) {
+    std::memcpy(buffer, mapping->data + position, size);
+    return;
+  }
+
+  if (descriptor_->direct && !isAligned(buffer, size, position)) {
+    // Read the aligned pages holding the bytes, and copy the bytes out.
+    const std::int64_t start = position - position % Page::SIZE;
+    const std::size_t length =
+        (position + size - start + Page::SIZE - 1) / Page::SIZE * Page::SIZE;
+    AlignedBuffer pages(length);
+    const int fd = descriptor_->fd;
+    std::size_t done = 0;
+    while (done < length) {
+      const ssize_t n = ::pread(fd, pages.data() + done, length - done, start + done);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n < 0) {
+        throw FileIOException(filename_, errno);
+      }
+      if (n == 0) {
+        break;
+      }
+      done += n;
+    }
+    std::memcpy(buffer, pages.data() + (position - start), size);
+    return;
+  }
+
+  char* bytes = static_cast<char*>(buffer);
+  std::size_t done = 0;
+  while (done < size) {
+    const ssize_t n = ::pread(descriptor_->fd, bytes + done, size - done, position + done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      throw FileIOException(filename_, errno);
+    }
+    if (n == 0) {
+      std::memset(bytes + done, 0, size - done);
+      break;
+    }
+    done += n;
+  }
+}
+
+void File::writeAt(const void* buffer, const std::size_t size,
+                   const std::int64_t position) {
+  const char* bytes = static_cast<const char*>(buffer);
+  std::size_t length = size;
+  std::unique_ptr<AlignedBuffer> pages;
+  if (descriptor_->direct && !isAligned(buffer, size, position)) {
+    assert(position % Page::SIZE == 0);
+    length = (size + Page::SIZE - 1) / Page::SIZE * Page::SIZE;
+    pages.reset(new AlignedBuffer(length));
+    std::memcpy(pages->data(), bytes, size);
+    bytes = pages->data();
+  }
+
+  std::size_t done = 0;
+  while (done < length) {
+    const ssize_t n = ::pwrite(descriptor_->fd, bytes + done, length - done, position + done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      throw FileIOException(filename_, errno);
+    }
+    done += n;
+  }
+  extendMapping(position + size);
+}
+
+void File::writeAt(const PageHeader& header, const Page& page,
+                   const std::int64_t position) {
+  if (descriptor_->direct) {
+    // O_DIRECT writes come from a single aligned buffer.
+    AlignedBuffer buffer(Page::SIZE);
+    std::memcpy(buffer.data(), &header, sizeof(PageHeader));
+    std::memcpy(buffer.data() + sizeof(PageHeader), page.data_, Page::DATA_SIZE);
+    writeAt(buffer.data(), Page::SIZE, position);
+    return;
+  }
+
+  struct iovec parts[2];
+  parts[0].iov_base = const_cast<PageHeader*>(&header);
+  parts[0].iov_len = sizeof(PageHeader);
+  parts[1].iov_base = const_cast<char*>(page.data_);
+  parts[1].iov_len = Page::DATA_SIZE;
+  ssize_t n;
+  do {
+    n = ::pwritev(descriptor_->fd, parts, 2, position);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    throw FileIOException(filename_, errno);
+  }
+
+  // Finish a short write with plain writes.
+  std::size_t done = n;
+  if (done < sizeof(PageHeader)) {
+    writeAt(reinterpret_cast<const char*>(&header) + done,
+            sizeof(PageHeader) - done, position + done);
+    done = sizeof(PageHeader);
+  }
+  if (done < Page::SIZE) {
+    writeAt(page.data_ + (done - sizeof(PageHeader)), Page::SIZE - done,
+            position + done);
+  }
+  extendMapping(position + Page::SIZE);
+}
+
+void File::extendMapping(const std::int64_t end) {
+  if (descriptor_->mapping.load() != NULL) {
+    // Only let the mapping be read up to the new end of the file once the
+    // bytes are written, mapping more of the file first if it is too short.
+    if (end > (std::int64_t)descriptor_->mapping.load()->length) {
+      std::lock_guard<std::mutex> guard(descriptor_->mapping_lock);
+      if (!descriptor_->map(std::max<std::int64_t>(2 * descriptor_->mapping.load()->length, end))) {
+        throw FileIOException(filename_, errno);
+      }
+    }
+    std::int64_t old_size = descriptor_->size;
+    while (old_size < end && !descriptor_->size.compare_exchange_weak(old_size, end)) {
+    }
+  }
+}
+
+void File::sync() {
+  if (::fdatasync(descriptor_->fd) != 0) {
+    throw FileIOException(filename_, errno);
+  }
+}
+
+void File::adviseSequential(const bool sequential) const {
+  const Mapping* mapping = descriptor_->mapping.load();
+  if (mapping != NULL) {
+    descriptor_->advice = sequential ? MADV_SEQUENTIAL : MADV_NORMAL;
+    ::madvise(mapping->data, mapping->length, descriptor_->advice);
+  } else {
+    ::posix_fadvise(descriptor_->fd, 0, 0,
+                    sequential ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_NORMAL);
+  }
+}
+
+void File::adviseWillNeed(const PageId first_page_number,
+                          const PageId num_pages) const {
+  if (first_page_number == Page::INVALID_NUMBER) {
+    return;
+  }
+  const std::int64_t start = pagePosition(first_page_number);
+  const std::int64_t length = (std::int64_t)num_pages * Page::SIZE;
+  const Mapping* mapping = descriptor_->mapping.load();
+  if (mapping != NULL) {
+    if (start < (std::int64_t)mapping->length) {
+      ::madvise(mapping->data + start,
+                std::min<std::int64_t>(length, mapping->length - start),
+                MADV_WILLNEED);
+    }
+  } else {
+    ::posix_fadvise(descriptor_->fd, start, length, POSIX_FADV_WILLNEED);
+  }
+}
+
+File::Descriptor::~Descriptor() {
+  for (std::size_t i = 0; i < mappings.size(); ++i) {
+    ::munmap(mappings[i]->data, mappings[i]->length);
+  }
+  ::close(fd);
+}
+
+bool File::Descriptor::map(const std::int64_t length) {
+  const Mapping* current = mapping.load();
+  if (current != NULL && (std::int64_t)current->length >= length) {
+    return true;
+  }
+  std::unique_ptr<Mapping> larger(new Mapping);
+  larger->length = (std::max(length, MIN_MAPPING_LENGTH) + Page::SIZE - 1) /
+                   Page::SIZE * Page::SIZE;
+  void* data = ::mmap(NULL, larger->length, PROT_READ, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  larger->data = static_cast<char*>(data);
+  if (advice != MADV_NORMAL) {
+    ::madvise(larger->data, larger->length, advice);
+  }
+  mapping = larger.get();
+  mappings.push_back(std::move(larger));
+  return true;
 }
 
 
@@ -163,147 +464,205 @@ PageFile& PageFile::operator=(const PageFile& rhs) {
 }
 
 Page PageFile::allocatePage(PageId &new_page_number) {
-  FileHeader header = readHeader();
   Page new_page;
-  Page existing_page;
+  allocatePage(new_page_number, new_page);
+  return new_page;
+}
+
+void PageFile::allocatePage(PageId &new_page_number, Page& new_page) {
+  std::lock_guard<std::mutex> guard(*update_lock_);
+  FileHeader header = readHeader();
   if (header.num_free_pages > 0) {
-    new_page = readPage(header.first_free_page, true /* allow_free */);
-    new_page.set_page_number(header.first_free_page);
-		new_page_number = new_page.page_number();
-    header.first_free_page = new_page.next_page_number();
+    // Reuse the lowest free page.  Every page before it is used, so it goes
+    // into the used list right after the page before it.
+    loadFreePages(header);
+    new_page_number = *free_pages_->begin();
+    free_pages_->erase(free_pages_->begin());
+    readPage(new_page_number, new_page, true /* allow_free */);
+
+    // Take it off the free list.
+    const PageId prev_free_page = new_page.prev_page_number();
+    const PageId next_free_page = new_page.next_page_number();
+    if (prev_free_page != Page::INVALID_NUMBER) {
+      setNextPage(prev_free_page, next_free_page);
+    } else {
+      header.first_free_page = next_free_page;
+    }
+    if (next_free_page != Page::INVALID_NUMBER) {
+      setPrevPage(next_free_page, prev_free_page);
+    }
     --header.num_free_pages;
 
-    if (header.first_used_page == Page::INVALID_NUMBER ||
-        header.first_used_page > new_page.page_number()) {
-      // Either have no pages used or the head of the used list is a page later
-      // than the one we just allocated, so add the new page to the head.
-      if (header.first_used_page > new_page.page_number()) {
-        new_page.set_next_page_number(header.first_used_page);
-      }
-      header.first_used_page = new_page.page_number();
+    // Put it on the used list.
+    const PageId prev_page_number = new_page_number - 1;
+    PageId next_page_number;
+    if (prev_page_number != Page::INVALID_NUMBER) {
+      next_page_number = readPageHeader(prev_page_number).next_page_number;
+      setNextPage(prev_page_number, new_page_number);
     } else {
-      // New page is reused from somewhere after the beginning, so we need to
-      // find where in the used list to insert it.
-      PageId next_page_number = Page::INVALID_NUMBER;
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        next_page_number = (*iter).next_page_number();
-        if (next_page_number > new_page.page_number() ||
-            next_page_number == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      existing_page.set_next_page_number(new_page.page_number());
-      new_page.set_next_page_number(next_page_number);
+      next_page_number = header.first_used_page;
+      header.first_used_page = new_page_number;
     }
+    if (next_page_number != Page::INVALID_NUMBER) {
+      setPrevPage(next_page_number, new_page_number);
+    } else {
+      header.last_used_page = new_page_number;
+    }
+    new_page.set_page_number(new_page_number);
+    new_page.set_next_page_number(next_page_number);
+    new_page.set_prev_page_number(prev_page_number);
 
     assert((header.num_free_pages == 0) ==
            (header.first_free_page == Page::INVALID_NUMBER));
   }
 	else
 	{
-    new_page.set_page_number(header.num_pages);
-		new_page_number = new_page.page_number();
+    // Append the page, after the last used page.
+    new_page.initialize();
+    new_page_number = header.num_pages;
+    new_page.set_page_number(new_page_number);
+    new_page.set_prev_page_number(header.last_used_page);
 
-    if (header.first_used_page == Page::INVALID_NUMBER)
+    if (header.last_used_page == Page::INVALID_NUMBER)
 		{
-      header.first_used_page = new_page.page_number();
+      header.first_used_page = new_page_number;
     }
 		else
 		{
-      // If we have pages allocated, we need to add the new page to the tail
-      // of the linked list.
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        if ((*iter).next_page_number() == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      assert(existing_page.isUsed());
-      existing_page.set_next_page_number(new_page.page_number());
+      setNextPage(header.last_used_page, new_page_number);
     }
+    header.last_used_page = new_page_number;
     ++header.num_pages;
   }
   writePage(new_page_number, new_page.header_, new_page);
-  if (existing_page.page_number() != Page::INVALID_NUMBER) {
-    // If we updated an existing page by inserting the new page into the
-    // used list, we need to write it out.
-    writePage(existing_page.page_number(), existing_page.header_, existing_page);
-  }
   writeHeader(header);
-
-  return new_page;
 }
 
 Page PageFile::readPage(const PageId page_number) const {
+  Page page;
+  readPage(page_number, page);
+  return page;
+}
+
+void PageFile::readPage(const PageId page_number, Page& page) const {
   FileHeader header = readHeader();
 
 	if (page_number >= header.num_pages)
 	{
 		throw InvalidPageException(page_number, filename_);
 	}
-	return readPage(page_number, false /* allow_free */);
+	readPage(page_number, page, false /* allow_free */);
 }
 
-Page PageFile::readPage(const PageId page_number, const bool allow_free) const {
-  Page page;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&page.header_), sizeof(PageHeader));
-  stream_->read(&page.data_[0], Page::DATA_SIZE);
+void PageFile::readPage(const PageId page_number, Page& page,
+                        const bool allow_free) const {
+  readAt(&page, Page::SIZE, pagePosition(page_number));
   if (!allow_free && !page.isUsed()) {
     throw InvalidPageException(page_number, filename_);
   }
-
-  return page;
 }
 
 void PageFile::writePage(const PageId new_page_number, const Page& new_page) {
-	PageHeader header = readPageHeader(new_page_number);
-	if (header.current_page_number == Page::INVALID_NUMBER)
+	std::lock_guard<std::mutex> guard(*update_lock_);
+	if (free_pages_->count(new_page_number) > 0)
 	{
 		// Page has been deleted since it was read.
 		throw InvalidPageException(new_page_number, filename_);
 	}
-	// Page on disk may have had its next page pointer updated since it was read;
-	// we don't modify that, but we do keep all the other modifications to the
-	// page header.
-	const PageId next_page_number = header.next_page_number;
-	header = new_page.header_;
-	header.next_page_number = next_page_number;
-	writePage(new_page_number, header, new_page);
+	// Page on disk may have had its next and previous page pointers updated
+	// since it was read; we don't modify those, but we do keep all the other
+	// modifications to the page header.
+	const PageLinkTable::const_iterator links = page_links_->find(new_page_number);
+	if (links == page_links_->end())
+	{
+		writeAt(&new_page, Page::SIZE, pagePosition(new_page_number));
+		return;
+	}
+	PageHeader header = new_page.header_;
+	header.next_page_number = links->second.next_page_number;
+	header.prev_page_number = links->second.prev_page_number;
+	writeAt(header, new_page, pagePosition(new_page_number));
+}
+
+void PageFile::writePages(const PageId first_page_number, Page* pages,
+                          const std::size_t num_pages) {
+  std::lock_guard<std::mutex> guard(*update_lock_);
+  // As in writePage, keep the page pointers the pages have on disk.  Only
+  // pointers the file changed since it was opened can differ from the pages'.
+  for (std::size_t i = 0; i < num_pages; ++i) {
+    const PageId page_number = first_page_number + i;
+    if (free_pages_->count(page_number) > 0) {
+      // Page has been deleted since it was read.
+      throw InvalidPageException(page_number, filename_);
+    }
+    const PageLinkTable::const_iterator links = page_links_->find(page_number);
+    if (links != page_links_->end()) {
+      pages[i].header_.next_page_number = links->second.next_page_number;
+      pages[i].header_.prev_page_number = links->second.prev_page_number;
+    }
+  }
+  writeAt(pages, num_pages * Page::SIZE, pagePosition(first_page_number));
 }
 
 void PageFile::deletePage(const PageId page_number) {
+  std::lock_guard<std::mutex> guard(*update_lock_);
   FileHeader header = readHeader();
+  loadFreePages(header);
 
   Page existing_page = readPage(page_number);
-  Page previous_page;
-  // If this page is the head of the used list, update the header to point to
-  // the next page in line.
-  if (page_number == header.first_used_page) {
-    header.first_used_page = existing_page.next_page_number();
+  // Take the page off the used list.
+  const PageId prev_page_number = existing_page.prev_page_number();
+  const PageId next_page_number = existing_page.next_page_number();
+  if (prev_page_number != Page::INVALID_NUMBER) {
+    setNextPage(prev_page_number, next_page_number);
   } else {
-    // Walk the used list so we can update the page that points to this one.
-    for (FileIterator iter = begin(); iter != end(); ++iter) {
-      previous_page = *iter;
-      if (previous_page.next_page_number() == existing_page.page_number()) {
-        previous_page.set_next_page_number(existing_page.next_page_number());
-        break;
-      }
-    }
+    header.first_used_page = next_page_number;
+  }
+  if (next_page_number != Page::INVALID_NUMBER) {
+    setPrevPage(next_page_number, prev_page_number);
+  } else {
+    header.last_used_page = prev_page_number;
   }
+
   // Clear the page and add it to the head of the free list.
   existing_page.initialize();
   existing_page.set_next_page_number(header.first_free_page);
+  if (header.first_free_page != Page::INVALID_NUMBER) {
+    setPrevPage(header.first_free_page, page_number);
+  }
   header.first_free_page = page_number;
   ++header.num_free_pages;
-  if (previous_page.isUsed()) {
-    writePage(previous_page.page_number(), previous_page.header_, previous_page);
-  }
+  free_pages_->insert(page_number);
   writePage(page_number, existing_page.header_, existing_page);
   writeHeader(header);
 }
 
+void PageFile::loadFreePages(const FileHeader& header) {
+  if (free_pages_->size() == header.num_free_pages) {
+    return;
+  }
+  free_pages_->clear();
+  for (PageId page_number = header.first_free_page;
+       page_number != Page::INVALID_NUMBER;
+       page_number = readPageHeader(page_number).next_page_number) {
+    free_pages_->insert(page_number);
+  }
+}
+
+void PageFile::setNextPage(const PageId page_number, const PageId link_number) {
+  Page page;
+  readPage(page_number, page, true /* allow_free */);
+  page.set_next_page_number(link_number);
+  writePage(page_number, page.header_, page);
+}
+
+void PageFile::setPrevPage(const PageId page_number, const PageId link_number) {
+  Page page;
+  readPage(page_number, page, true /* allow_free */);
+  page.set_prev_page_number(link_number);
+  writePage(page_number, page.header_, page);
+}
+
 FileIterator PageFile::begin() {
   const FileHeader& header = readHeader();
   return FileIterator(this, header.first_used_page);
@@ -315,16 +674,14 @@ FileIterator PageFile::end() {
 
 void PageFile::writePage(const PageId page_number, const PageHeader& header,
                      const Page& new_page) {
-  stream_->seekp(pagePosition(page_number), std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(PageHeader));
-  stream_->write(&new_page.data_[0], Page::DATA_SIZE);
-  stream_->flush();
+  const PageLinks links = {header.next_page_number, header.prev_page_number};
+  (*page_links_)[page_number] = links;
+  writeAt(header, new_page, pagePosition(page_number));
 }
 
 PageHeader PageFile::readPageHeader(PageId page_number) const {
   PageHeader header;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(PageHeader));
+  readAt(&header, sizeof(PageHeader), pagePosition(page_number));
   return header;
 }
 
@@ -361,8 +718,15 @@ BlobFile& BlobFile::operator=(const BlobFile& rhs) {
 }
 
 Page BlobFile::allocatePage(PageId &new_page_number) {
-  FileHeader header = readHeader();
 	Page new_page;
+	allocatePage(new_page_number, new_page);
+	return new_page;
+}
+
+void BlobFile::allocatePage(PageId &new_page_number, Page& new_page) {
+  std::lock_guard<std::mutex> guard(*update_lock_);
+  FileHeader header = readHeader();
+	new_page.initialize();
 
 	new_page_number = header.num_pages;
 
@@ -374,21 +738,39 @@ Page BlobFile::allocatePage(PageId &new_page_number) {
 
 	writePage(new_page_number, new_page);
 	writeHeader(header);
+}
 
-	return new_page;
+PageId BlobFile::allocatePages(const PageId num_pages) {
+  std::lock_guard<std::mutex> guard(*update_lock_);
+  FileHeader header = readHeader();
+	const PageId first_page_number = header.num_pages;
+
+	if (header.first_used_page == Page::INVALID_NUMBER && num_pages > 0) {
+		header.first_used_page = header.num_pages;
+	}
+
+	header.num_pages += num_pages;
+
+	writeHeader(header);
+	return first_page_number;
 }
 
 Page BlobFile::readPage(const PageId page_number) const {
 	Page page;
-	stream_->seekg(pagePosition(page_number), std::ios::beg);
-	stream_->read(reinterpret_cast<char*>(&page), Page::SIZE);
+	readPage(page_number, page);
 	return page;
 }
 
+void BlobFile::readPage(const PageId page_number, Page& page) const {
+	readAt(&page, Page::SIZE, pagePosition(page_number));
+}
+
 void BlobFile::writePage(const PageId new_page_number, const Page& new_page) {
-	stream_->seekp(pagePosition(new_page_number), std::ios::beg);
-	stream_->write(reinterpret_cast<const char*>(&new_page), Page::SIZE);
-	stream_->flush();
+	writeAt(&new_page, Page::SIZE, pagePosition(new_page_number));
+}
+
+void BlobFile::writePages(const PageId first_page_number, Page* pages, const std::size_t num_pages) {
+	writeAt(pages, num_pages * Page::SIZE, pagePosition(first_page_number));
 }
 
 //delePage should not be called for a blob_file, not supported
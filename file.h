@@ -7,10 +7,15 @@
 
 #pragma once
 
-#include <fstream>
+#include <atomic>
+#include <cstdint>
 #include <string>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
 
 #include "page.h"
 
@@ -18,10 +23,35 @@ namespace badgerdb {
 
 class FileIterator;
 
+/**
+ * @brief Value of FileHeader::magic in every file written by this code.
+ */
+const std::uint32_t FILEMAGIC = 0x46474442;  // "BDGF"
+
+/**
+ * @brief Version of the file layout described by FileHeader.
+ *
+ * Version 2 is the pread/pwrite layout: the header takes the place of page 0,
+ * page n starts at n * Page::SIZE, and the header records the last used page.
+ * Files of the earlier fstream layout, which had neither a magic number nor a
+ * version, cannot be read, and opening one throws BadFileFormatException.
+ */
+const std::uint32_t FILEVERSION = 2;
+
 /**
  * @brief Header metadata for files on disk which contain pages.
  */
 struct FileHeader {
+  /**
+   * FILEMAGIC, telling files of this code from any other file.
+   */
+  std::uint32_t magic;
+
+  /**
+   * FILEVERSION of the code that created the file.
+   */
+  std::uint32_t version;
+
   /**
    * Number of pages allocated in the file.
    */
@@ -42,6 +72,11 @@ struct FileHeader {
    */
   PageId first_free_page;
 
+  /**
+   * Page number of the last used page in the file.
+   */
+  PageId last_used_page;
+
   /**
    * Returns true if this file header is equal to the other.
    *
@@ -49,10 +84,13 @@ struct FileHeader {
    * @return  True if the other header is equal to this one.
    */
   bool operator==(const FileHeader& rhs) const {
-    return num_pages == rhs.num_pages &&
+    return magic == rhs.magic &&
+        version == rhs.version &&
+        num_pages == rhs.num_pages &&
         num_free_pages == rhs.num_free_pages &&
         first_used_page == rhs.first_used_page &&
-        first_free_page == rhs.first_free_page;
+        first_free_page == rhs.first_free_page &&
+        last_used_page == rhs.last_used_page;
   }
 };
 
@@ -60,15 +98,17 @@ struct FileHeader {
  * @brief Class which represents a file in the filesystem containing database
  *        pages.
  *
- * The File class wraps a stream to an underlying file on disk.  Files contain
- * fixed-sized pages, and they never deallocate space (though they do reuse
- * deleted pages if possible).  If multiple File objects refer to the same
- * underlying file, they will share the stream in memory.
+ * The File class wraps a descriptor of an underlying file on disk, which is
+ * read and written with pread and pwrite.  Files contain fixed-sized pages,
+ * and they never deallocate space (though they do reuse deleted pages if
+ * possible).  If multiple File objects refer to the same underlying file, they
+ * will share the descriptor.
  * If a file that has already been opened (possibly by another query), then the File class
- * detects this (by looking in the open_streams_ map) and just returns a file object with
- * the already created stream for the file without actually opening the UNIX file again. 
+ * detects this (by looking in the open_descriptors_ map) and just returns a file object with
+ * the already opened descriptor for the file without actually opening the UNIX file again. 
  *
- * @warning This class is not threadsafe.
+ * @warning Opening and closing files is not threadsafe.  Pages of an open file
+ *          may be read, written, allocated and deleted from several threads.
  */
 
 
@@ -84,6 +124,8 @@ class File {
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
+   * @throws  BadFileFormatException  If the existing file is not in the
+   *                                  current layout.
    */
   File(const std::string& name, const bool create_new);
 
@@ -111,6 +153,26 @@ class File {
    */
   static bool exists(const std::string& filename);
 
+  /**
+   * Sets whether files opened from now on bypass the operating system's cache
+   * using O_DIRECT.  Files on filesystems that do not support it are opened
+   * normally.  Files already open are not affected.
+   *
+   * @param direct  True to open files with O_DIRECT.
+   */
+  static void setDirectIO(const bool direct) { direct_io_ = direct; }
+
+  /**
+   * Sets whether files opened from now on are read through a shared memory
+   * mapping rather than with pread, so that reading a page copies it straight
+   * out of the operating system's cache.  Writes still use pwrite, which the
+   * mapping sees.  Files opened with O_DIRECT are never mapped, and files
+   * already open are not affected.
+   *
+   * @param mapped  True to map files.
+   */
+  static void setMemoryMapped(const bool mapped) { memory_mapped_ = mapped; }
+
   /**
    * Destructor that automatically closes the underlying file if no other
    * File objects are using it.
@@ -124,6 +186,15 @@ class File {
    */
   virtual Page allocatePage(PageId &new_page_number) = 0;
 
+  /**
+   * Allocates a new page in the file, setting up the given page as its
+   * contents rather than returning a copy.
+   *
+   * @param new_page_number   Set to the number of the new page.
+   * @param new_page          Set to the new page.
+   */
+  virtual void allocatePage(PageId &new_page_number, Page& new_page) = 0;
+
   /**
    * Reads an existing page from the file.
    *
@@ -134,6 +205,17 @@ class File {
    */
   virtual Page readPage(const PageId page_number) const = 0;
 
+  /**
+   * Reads an existing page from the file straight into the given page, such
+   * as a frame of the buffer pool, rather than returning a copy.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Set to the page read.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  virtual void readPage(const PageId page_number, Page& page) const = 0;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -143,6 +225,19 @@ class File {
    */
   virtual void writePage(const PageId page_number, const Page& new_page) = 0;
 
+  /**
+   * Writes pages into the file at consecutive page numbers, positioning and
+   * writing them with a single call.  The pages are written from where they
+   * are, so a PageFile sets their page pointers to the ones on disk first.
+   * No bounds checking is performed.
+   *
+   * @param first_page_number Number of the page to replace with the first page.
+   * @param pages             Pages to write, one after another in memory.
+   * @param num_pages         Number of pages to write.
+   */
+  virtual void writePages(const PageId first_page_number, Page* pages,
+                          const std::size_t num_pages) = 0;
+
   /**
    * Deletes a page from the file.
    *
@@ -150,6 +245,39 @@ class File {
    */
   virtual void deletePage(const PageId page_number) = 0;
 
+  /**
+   * Waits until the pages written to the file are on disk.  Memory-mapped
+   * files are synced the same way: their mapping is read-only and every
+   * write goes through pwrite, so it has no dirty pages of its own to flush.
+   *
+   * @throws  FileIOException   If the pages could not be written.
+   */
+  void sync();
+
+  /**
+   * Tells the operating system whether the pages of the file are about to be
+   * read in order, so that it reads further ahead of them and drops them
+   * sooner once read.
+   *
+   * @param sequential  True while the file is read in order.
+   */
+  void adviseSequential(const bool sequential) const;
+
+  /**
+   * Tells the operating system the given pages are about to be read, so that
+   * it can start reading them in.  Nothing is done for Page::INVALID_NUMBER,
+   * which ends a list of pages.
+   *
+   * @param first_page_number   Number of the first page.
+   * @param num_pages           Number of pages from the first.
+   */
+  void adviseWillNeed(const PageId first_page_number, const PageId num_pages) const;
+
+  /**
+   * Returns true if the file is read through a memory mapping.
+   */
+  bool memoryMapped() const { return descriptor_->mapping.load() != NULL; }
+
   /**
    * Returns the name of the file this object represents.
    *
@@ -164,22 +292,31 @@ class File {
    */
 	PageId getFirstPageNo();
 
+  /**
+   * Returns the number of pages in the file, counting the header and the
+   * free pages, so that every page of the file has a lower number.
+   *
+   * @return  Number of pages in the file.
+   */
+  PageId getNumPages() const;
+
  protected:
   /**
    * Returns the position of the page with the given number in the file (as an
-   * offset from the beginning of the file).
+   * offset from the beginning of the file).  The header takes the place of
+   * page 0, so that every page is aligned for O_DIRECT.
    *
    * @param page_number   Number of page.
    * @return  Position of page in file.
    */
-  static std::streampos pagePosition(const PageId page_number) {
-    return sizeof(FileHeader) + ((page_number - 1) * Page::SIZE);
+  static std::int64_t pagePosition(const PageId page_number) {
+    return (std::int64_t)page_number * Page::SIZE;
   }
 
   /**
    * Opens the underlying file named in filename_.
    * This method only opens the file if no other File objects exist that access
-   * the same filesystem file; otherwise, it reuses the existing stream.
+   * the same filesystem file; otherwise, it reuses the existing descriptor.
    *
    * @param create_new  Whether to create a new file.
    * @throws  FileExistsException     If the underlying file exists and
@@ -190,7 +327,7 @@ class File {
   void openIfNeeded(const bool create_new);
 
   /**
-   * Closes the underlying file stream in <stream_>.
+   * Closes the underlying file descriptor in <descriptor_>.
    * This method only closes the file if no other File objects exist that access
    * the same file.
    */
@@ -210,28 +347,199 @@ class File {
    */
   void writeHeader(const FileHeader& header);
 
-  typedef std::map<std::string, std::shared_ptr<std::fstream> > StreamMap;
+  /**
+   * Reads bytes from the file.  Bytes past the end of the file read as zero.
+   *
+   * @param buffer    Buffer to read into.
+   * @param size      Number of bytes to read.
+   * @param position  Offset in the file to read from.
+   * @throws  FileIOException   If the read fails.
+   */
+  void readAt(void* buffer, const std::size_t size,
+              const std::int64_t position) const;
+
+  /**
+   * Writes bytes to the file.  With O_DIRECT, position must be aligned to a
+   * page, and the last page written is padded with zeros.
+   *
+   * @param buffer    Bytes to write.
+   * @param size      Number of bytes to write.
+   * @param position  Offset in the file to write at.
+   * @throws  FileIOException   If the write fails.
+   */
+  void writeAt(const void* buffer, const std::size_t size,
+               const std::int64_t position);
+
+  /**
+   * Writes a page with another header in place of its own, gathering the two
+   * with pwritev rather than copying the page.  With O_DIRECT they are copied
+   * into one aligned page, which position must be aligned to.
+   *
+   * @param header    Header to write.
+   * @param page      Page whose data follows the header.
+   * @param position  Offset in the file to write at.
+   * @throws  FileIOException   If the write fails.
+   */
+  void writeAt(const PageHeader& header, const Page& page,
+               const std::int64_t position);
+
+  /**
+   * Lets a mapped file be read up to the given end once the bytes before it
+   * are written, mapping more of the file if the mapping is too short.
+   *
+   * @param end   Offset just past the last byte written.
+   * @throws  FileIOException   If the file could not be mapped again.
+   */
+  void extendMapping(const std::int64_t end);
+
+  /**
+   * A read-only shared mapping of the start of a file.  It may reach past the
+   * end of the file, so that the file can grow without mapping it again, but
+   * only the bytes within the file may be read.
+   */
+  struct Mapping {
+    char* data;
+    std::size_t length;
+  };
+
+  /**
+   * An open file descriptor, closed when no File object uses it any more.
+   */
+  struct Descriptor {
+    /**
+     * The descriptor.
+     */
+    int fd;
+
+    /**
+     * True if the file was opened with O_DIRECT.
+     */
+    bool direct;
+
+    /**
+     * The mapping the file is read through, or NULL if it is read with pread.
+     */
+    std::atomic<const Mapping*> mapping;
+
+    /**
+     * Size of the file in bytes, kept only for mapped files.  It grows only
+     * once the bytes have been written, so the mapping may be read up to it.
+     */
+    std::atomic<std::int64_t> size;
+
+    /**
+     * Advice given to the operating system for the mapping, applied again
+     * when the mapping is replaced.
+     */
+    std::atomic<int> advice;
+
+    /**
+     * Held while the mapping is replaced by a larger one.
+     */
+    std::mutex mapping_lock;
+
+    /**
+     * Every mapping made of the file.  Mappings replaced by larger ones are
+     * only unmapped when the file is closed, as other threads may still be
+     * reading from them.
+     */
+    std::vector<std::unique_ptr<Mapping> > mappings;
+
+    Descriptor(const int file_descriptor, const bool direct_io)
+        : fd(file_descriptor), direct(direct_io), mapping(NULL), size(0),
+          advice(0) {}
+    ~Descriptor();
+
+    /**
+     * Maps at least the first length bytes of the file, replacing the current
+     * mapping if it is shorter.  The caller holds mapping_lock.
+     *
+     * @param length  Number of bytes to map.
+     * @return  False if the file could not be mapped.
+     */
+    bool map(const std::int64_t length);
+  };
+
+  typedef std::map<std::string, std::shared_ptr<Descriptor> > DescriptorMap;
   typedef std::map<std::string, int> CountMap;
+  typedef std::map<std::string, std::shared_ptr<std::mutex> > LockMap;
+  typedef std::map<std::string, std::shared_ptr<std::set<PageId> > > PageSetMap;
 
   /**
-   * Streams for opened files.
+   * Next and previous page pointers of a page.
    */
-  static StreamMap open_streams_;
+  struct PageLinks {
+    PageId next_page_number;
+    PageId prev_page_number;
+  };
+
+  typedef std::unordered_map<PageId, PageLinks> PageLinkTable;
+  typedef std::map<std::string, std::shared_ptr<PageLinkTable> > PageLinkTableMap;
+
+  /**
+   * Descriptors for opened files.
+   */
+  static DescriptorMap open_descriptors_;
 
   /**
    * Counts for opened files.
    */
   static CountMap open_counts_;
 
+  /**
+   * Locks for changes to the pages of opened files.
+   */
+  static LockMap open_locks_;
+
+  /**
+   * Free pages of opened files.
+   */
+  static PageSetMap open_free_pages_;
+
+  /**
+   * Page pointers changed in opened files.
+   */
+  static PageLinkTableMap open_page_links_;
+
+  /**
+   * Whether files are opened with O_DIRECT.
+   */
+  static bool direct_io_;
+
+  /**
+   * Whether files are read through a memory mapping.
+   */
+  static bool memory_mapped_;
+
   /**
    * Name of the file this object represents.
    */
   std::string filename_;
 
   /**
-   * Stream for underlying filesystem object.
+   * Descriptor for underlying filesystem object.
+   */
+  std::shared_ptr<Descriptor> descriptor_;
+
+  /**
+   * Held while pages are allocated, written or deleted, as these change the
+   * file header and the links between pages.  Reads take no lock.
+   */
+  std::shared_ptr<std::mutex> update_lock_;
+
+  /**
+   * Numbers of the free pages in the file, so that the lowest can be found
+   * without reading the free list.  Filled in from the free list when it does
+   * not match the header, and guarded by update_lock_.
+   */
+  std::shared_ptr<std::set<PageId> > free_pages_;
+
+  /**
+   * Page pointers the file has written to pages since it was opened, guarded
+   * by update_lock_.  Copies of a page read before its pointers changed still
+   * hold the old ones, so pages written back take their pointers from here.
    */
-  std::shared_ptr<std::fstream> stream_;
+  std::shared_ptr<PageLinkTable> page_links_;
 
   friend class FileIterator;
 };
@@ -249,13 +557,14 @@ class PageFile : public File {
 
   /**
    * Opens the file named fileName and returns the corresponding File object.
-	 * It first checks if the file is already open. If so, then the new File object created uses the same input-output stream to read to or write fom
+	 * It first checks if the file is already open. If so, then the new File object created uses the same file descriptor to read to or write fom
 	 * that already open file. Reference count (open_counts_ static variable inside the File object) is incremented whenever an already open file is
-	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the stream associated with this File object are inserted into the
-	 * open_streams_ map.
+	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the descriptor associated with this File object are inserted into the
+	 * open_descriptors_ map.
    *
    * @param filename  Name of the file.
    * @throws  FileNotFoundException   If the requested file doesn't exist.
+   * @throws  BadFileFormatException  If the file is not in the current layout.
    */
   static PageFile open(const std::string& filename);
 
@@ -268,6 +577,8 @@ class PageFile : public File {
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
+   * @throws  BadFileFormatException  If the existing file is not in the
+   *                                  current layout.
    */
   PageFile(const std::string& name, const bool create_new);
 
@@ -300,6 +611,15 @@ class PageFile : public File {
    */
   Page allocatePage(PageId &new_page_number) override;
 
+  /**
+   * Allocates a new page in the file, setting up the given page as its
+   * contents rather than returning a copy.
+   *
+   * @param new_page_number   Set to the number of the new page.
+   * @param new_page          Set to the new page.
+   */
+  void allocatePage(PageId &new_page_number, Page& new_page) override;
+
   /**
    * Reads an existing page from the file.
    *
@@ -310,6 +630,17 @@ class PageFile : public File {
    */
   Page readPage(const PageId page_number) const override;
 
+  /**
+   * Reads an existing page from the file straight into the given page, such
+   * as a frame of the buffer pool, rather than returning a copy.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Set to the page read.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void readPage(const PageId page_number, Page& page) const override;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -319,6 +650,19 @@ class PageFile : public File {
    */
   void writePage(const PageId page_number, const Page& new_page) override;
 
+  /**
+   * Writes pages into the file at consecutive page numbers, positioning and
+   * writing them with a single call.  The pages are written from where they
+   * are, so a PageFile sets their page pointers to the ones on disk first.
+   * No bounds checking is performed.
+   *
+   * @param first_page_number Number of the page to replace with the first page.
+   * @param pages             Pages to write, one after another in memory.
+   * @param num_pages         Number of pages to write.
+   */
+  void writePages(const PageId first_page_number, Page* pages,
+                  const std::size_t num_pages) override;
+
   /**
    * Deletes a page from the file.
    *
@@ -347,21 +691,23 @@ class PageFile : public File {
    * Reads a page from the file.  If <allow_free> is not set, an exception
    * will be thrown if the page read from disk is not currently in use.
    *
-   * No bounds checking is performed; the underlying file stream will throw
-   * an exception if the page is past the end of the file.
+   * No bounds checking is performed; a page past the end of the file reads
+   * as zeros, and so as a free page.
    *
    * @param page_number   Number of page to read.
+   * @param page          Set to the page read.
    * @param allow_free    Whether to allow reading a free (unused) page.
-   * @return  The page.
    * @throws  InvalidPageException  If the page is free (unused) and
    *                                allow_free is false.
    */
-  Page readPage(const PageId page_number, const bool allow_free) const;
+  void readPage(const PageId page_number, Page& page,
+                const bool allow_free) const;
 
   /**
    * Writes a page into the file at the given page number with the given header.
    * This does not ensure that the number in the header equals the position on
-   * disk.  No bounds checking is performed.
+   * disk.  The page pointers in the header are kept in page_links_ as the
+   * page's own.  No bounds checking is performed.
    *
    * @param page_number Number of page whose contents to replace.
    * @param header      Header of page to write.
@@ -379,6 +725,24 @@ class PageFile : public File {
    */
   PageHeader readPageHeader(const PageId page_number) const;
 
+  /**
+   * Fills in free_pages_ from the free list, unless it already holds as many
+   * pages as the header counts.
+   *
+   * @param header  Header of the file.
+   */
+  void loadFreePages(const FileHeader& header);
+
+  /**
+   * Changes the next or previous page pointer of a page on disk, leaving the
+   * rest of the page as it is.
+   *
+   * @param page_number   Number of page to change.
+   * @param link_number   New page number for the pointer.
+   */
+  void setNextPage(const PageId page_number, const PageId link_number);
+  void setPrevPage(const PageId page_number, const PageId link_number);
+
   friend class FileIterator;
 };
 
@@ -395,13 +759,14 @@ class BlobFile : public File {
 
   /**
    * Opens the file named fileName and returns the corresponding File object.
-	 * It first checks if the file is already open. If so, then the new File object created uses the same input-output stream to read to or write fom
+	 * It first checks if the file is already open. If so, then the new File object created uses the same file descriptor to read to or write fom
 	 * that already open file. Reference count (open_counts_ static variable inside the File object) is incremented whenever an already open file is
-	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the stream associated with this File object are inserted into the
-	 * open_streams_ map.
+	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the descriptor associated with this File object are inserted into the
+	 * open_descriptors_ map.
    *
    * @param filename  Name of the file.
    * @throws  FileNotFoundException   If the requested file doesn't exist.
+   * @throws  BadFileFormatException  If the file is not in the current layout.
    */
   static BlobFile open(const std::string& filename);
 
@@ -416,6 +781,8 @@ class BlobFile : public File {
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
+   * @throws  BadFileFormatException  If the existing file is not in the
+   *                                  current layout.
    */
   BlobFile(const std::string& name, const bool create_new);
 
@@ -448,6 +815,25 @@ class BlobFile : public File {
    */
   Page allocatePage(PageId &new_page_number) override;
 
+  /**
+   * Allocates a new page in the file, setting up the given page as its
+   * contents rather than returning a copy.
+   *
+   * @param new_page_number   Set to the number of the new page.
+   * @param new_page          Set to the new page.
+   */
+  void allocatePage(PageId &new_page_number, Page& new_page) override;
+
+  /**
+   * Allocates a range of consecutive new pages in the file without writing
+   * them, so that several threads can fill the range with writePages().  A
+   * page of the range reads back as zeros until it is written.
+   *
+   * @param num_pages   Number of pages to allocate.
+   * @return  Number of the first page of the range.
+   */
+  PageId allocatePages(const PageId num_pages);
+
   /**
    * Reads an existing page from the file.
    *
@@ -458,6 +844,17 @@ class BlobFile : public File {
    */
   Page readPage(const PageId page_number) const override;
 
+  /**
+   * Reads an existing page from the file straight into the given page, such
+   * as a frame of the buffer pool, rather than returning a copy.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Set to the page read.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void readPage(const PageId page_number, Page& page) const override;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -467,6 +864,19 @@ class BlobFile : public File {
    */
   void writePage(const PageId page_number, const Page& new_page) override;
 
+  /**
+   * Writes pages into the file at consecutive page numbers, positioning and
+   * writing them with a single call.  The pages are written from where they
+   * are, so a PageFile sets their page pointers to the ones on disk first.
+   * No bounds checking is performed.
+   *
+   * @param first_page_number Number of the page to replace with the first page.
+   * @param pages             Pages to write, one after another in memory.
+   * @param num_pages         Number of pages to write.
+   */
+  void writePages(const PageId first_page_number, Page* pages,
+                  const std::size_t num_pages) override;
+
   /**
    * Deletes a page from the file.
    *
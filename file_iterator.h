@@ -85,13 +85,13 @@ class FileIterator {
    * @return    True if other iterator is equal to this one.
    */
 	inline bool operator==(const FileIterator& rhs) const {
-    return file_->filename() == rhs.file_->filename() &&
-        current_page_number_ == rhs.current_page_number_;
+    // Only compare file names for iterators over different File objects.
+    return current_page_number_ == rhs.current_page_number_ &&
+        (file_ == rhs.file_ || file_->filename() == rhs.file_->filename());
   }
 
 	inline bool operator!=(const FileIterator& rhs) const {
-    return (file_->filename() != rhs.file_->filename()) ||
-        (current_page_number_ != rhs.current_page_number_);
+    return !(*this == rhs);
   }
 
   /**
@@ -103,6 +103,15 @@ class FileIterator {
 	inline Page operator*() const
   { return file_->readPage(current_page_number_); }
 
+  /**
+   * Returns the number of the current page, without reading the page.
+   *
+   * @return  Number of the current page.
+   */
+  inline PageId getCurrentPageNumber() const {
+    return current_page_number_;
+  }
+
  private:
   /**
    * File we're iterating over.
@@ -5,103 +5,217 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
+#include <cstring>
 #include "filescan.h"
 #include "exceptions/end_of_file_exception.h"
 
 namespace badgerdb { 
 
-FileScan::FileScan(const std::string &name, BufMgr *bufferMgr)
+namespace {
+
+// compare two values as the operator says
+template <class T>
+bool compare(const T& lhs, const Operator op, const T& rhs)
+{
+  switch (op)
+  {
+    case LT:
+      return lhs < rhs;
+    case LTE:
+      return lhs <= rhs;
+    case GTE:
+      return lhs >= rhs;
+    case GT:
+      return lhs > rhs;
+    case EQ:
+      return lhs == rhs;
+    default:
+      return lhs != rhs;
+  }
+}
+
+// append the attributes of the record to the bytes; attributes past the end of a record read as NULs
+void appendProjection(std::string& bytes, const RecordView& record, const std::vector<ScanAttribute>& attributes)
+{
+  for (std::size_t i = 0; i < attributes.size(); i++)
+  {
+    const std::size_t offset = std::min(record.size(), (std::size_t)attributes[i].attrByteOffset);
+    const std::size_t length = std::min(record.size() - offset, (std::size_t)attributes[i].attrLength);
+    bytes.append(record.data() + offset, length);
+    bytes.append(attributes[i].attrLength - length, '\0');
+  }
+}
+
+}
+
+void RecordBatch::append(const RecordId& rid, const RecordView& record, const std::vector<ScanAttribute>& attributes)
+{
+  rids.push_back(rid);
+  appendProjection(bytes, record, attributes);
+  offsets.push_back(bytes.size());
+}
+
+ScanPredicate::ScanPredicate(const int attrByteOffset, const Operator op, const int value)
+  : attrByteOffset(attrByteOffset), attrLength(sizeof(int)), type(INTEGER), op(op), intValue(value), doubleValue(0)
+{
+}
+
+ScanPredicate::ScanPredicate(const int attrByteOffset, const Operator op, const double value)
+  : attrByteOffset(attrByteOffset), attrLength(sizeof(double)), type(DOUBLE), op(op), intValue(0), doubleValue(value)
+{
+}
+
+ScanPredicate::ScanPredicate(const int attrByteOffset, const Operator op, const std::string& value, const int attrLength)
+  : attrByteOffset(attrByteOffset), attrLength(attrLength), type(STRING), op(op), intValue(0), doubleValue(0),
+    stringValue(value, 0, std::min(value.size(), (std::size_t)attrLength))
+{
+  // pad the constant to the length of the field, so both are compared byte by byte
+  stringValue.resize(attrLength, '\0');
+}
+
+bool ScanPredicate::matches(const RecordView& record) const
+{
+  if (record.size() < (std::size_t)(attrByteOffset + attrLength))
+    return false;
+
+  // records are not necessarily aligned, so attributes are copied out
+  const char* attr = record.data() + attrByteOffset;
+  switch (type)
+  {
+    case INTEGER:
+    {
+      int value;
+      memcpy(&value, attr, sizeof(value));
+      return compare(value, op, intValue);
+    }
+    case DOUBLE:
+    {
+      double value;
+      memcpy(&value, attr, sizeof(value));
+      return compare(value, op, doubleValue);
+    }
+    default:
+    {
+      // a field is read up to its first NUL, which strncmp does not look past
+      return compare(strncmp(attr, stringValue.data(), attrLength), op, 0);
+    }
+  }
+}
+
+
+FileScan::FileScan(const std::string &name, BufMgr *bufferMgr, const std::uint32_t ringSize)
 {
   file = new PageFile(name, false);	//dont create new file
 	bufMgr = bufferMgr;
-	curDirtyFlag = false;
-  curPage = NULL;
-	filePageIter = file->begin();
+  ring = ringSize > 0 ? new BufRing(ringSize) : NULL;
+  // read ahead no further than half the ring, so that pages read ahead are not reused before they are scanned
+  prefetchDepth = ring != NULL ? std::min(PREFETCHDEPTH, ringSize / 2) : PREFETCHDEPTH;
+  scanStarted = false;
+  file->adviseSequential(true);
 }
 
 FileScan::~FileScan()
 {
   // generally must unpin last page of the scan
-  if (curPage != NULL)
-  {
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
-    curPage = NULL;
-		curDirtyFlag = false;
-    filePageIter = file->begin();
-  }
+  filePageIter = BufFileIterator();
   bufMgr->flushFile(file);
+  file->adviseSequential(false);
   delete file;
+  delete ring;
 }
 
 void FileScan::scanNext(RecordId& outRid)
 {
-  std::string rec;
-
-  if (filePageIter == file->end())
+  if (!tryScanNext(outRid))
 	{
 		throw EndOfFileException();
 	}
+}
 
+bool FileScan::tryScanNext(RecordId& outRid)
+{
+  while (nextRecord(outRid))
+  {
+    RecordView record = pageRecordIter.getRecordView();
+    bool matches = true;
+    for (std::size_t i = 0; i < predicates.size() && matches; i++)
+      matches = predicates[i].matches(record);
+    if (matches)
+      return true;
+  }
+  return false;
+}
+
+bool FileScan::nextBatch(RecordBatch& batch)
+{
+  batch.clear();
+  RecordId outRid;
+  while (batch.size() < batch.capacity() && tryScanNext(outRid))
+  {
+    if (projection.empty())
+      batch.append(outRid, pageRecordIter.getRecordView());
+    else
+      batch.append(outRid, pageRecordIter.getRecordView(), projection);
+  }
+  return batch.size() > 0;
+}
+
+bool FileScan::nextRecord(RecordId& outRid)
+{
   // special case of the first record of the first page of the file
-  if (curPage == NULL)
+  if (!scanStarted)
   {
-    // need to get the first page of the file
-		filePageIter = file->begin();
-    if(filePageIter == file->end())
+    scanStarted = true;
+
+		// read the first page of the file
+    filePageIter = BufFileIterator(file, bufMgr, ring);
+    if (filePageIter.atEnd())
 		{
-			throw EndOfFileException();
+			return false;
 		}
-	 
-		// read the first page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage); 
-		curDirtyFlag = false;
+    readAhead();
 
 		// get the first record off the page
-    pageRecordIter = curPage->begin(); 
-
-		if(pageRecordIter != curPage->end()) 
+    pageRecordIter = filePageIter->begin();
+  }
+  else
+  {
+    if (filePageIter.atEnd())
 		{
-		  // get pointer to record
-		  rec = *pageRecordIter;
-
-			outRid = pageRecordIter.getCurrentRecord();
-			return;
+			return false;
 		}
-  }
 
-	// Loop, looking for a record that satisfied the predicate.
-	// First try and get the next record off the current page
-	pageRecordIter++;
+		// Loop, looking for a record that satisfied the predicate.
+		// First try and get the next record off the current page
+		pageRecordIter++;
+  }
 
-  while (pageRecordIter == curPage->end())
+  while (pageRecordIter == filePageIter->end())
   {
-    // unpin the current page
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
-    curPage = NULL;
-    curDirtyFlag = false;
-
-    filePageIter++;
-    if (filePageIter == file->end())
+    // move on to the next page of the file, which unpins the current page.
+    // The next page number is taken from the pinned page, so the page is
+    // read from the file only once.
+    ++filePageIter;
+    if (filePageIter.atEnd())
     {
-      curPage = NULL;
-			throw EndOfFileException();
+			return false;
     }
-
-    // read the next page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage);
+    readAhead();
 
     // get the first record off the page
-    pageRecordIter = curPage->begin(); 
+    pageRecordIter = filePageIter->begin();
   }
 
-  // curRec points at a valid record
-  // see if the record satisfies the scan's predicate 
-  // get a pointer to the record
-  rec = *pageRecordIter;
-
 	// return rid of the record
 	outRid = pageRecordIter.getCurrentRecord();
-	return;
+	return true;
+}
+
+void FileScan::readAhead()
+{
+  file->adviseWillNeed(filePageIter->next_page_number(), prefetchDepth);
+  bufMgr->prefetchChain(file, filePageIter->next_page_number(), prefetchDepth, ring);
 }
 
 // returns pointer to the current record.  page is left pinned
@@ -111,10 +225,39 @@ std::string FileScan::getRecord()
   return *pageRecordIter;
 }
 
+RecordView FileScan::getRecordView()
+{
+  return pageRecordIter.getRecordView();
+}
+
+void FileScan::addPredicate(const ScanPredicate& predicate)
+{
+  predicates.push_back(predicate);
+}
+
+void FileScan::setProjection(const std::vector<ScanAttribute>& attributes)
+{
+  projection = attributes;
+}
+
+const std::string& FileScan::getProjectedRecord()
+{
+  RecordView record = pageRecordIter.getRecordView();
+  if (projection.empty())
+  {
+    projectedRecord.assign(record.data(), record.size());
+    return projectedRecord;
+  }
+
+  projectedRecord.clear();
+  appendProjection(projectedRecord, record, projection);
+  return projectedRecord;
+}
+
 // mark current page of scan dirty
 void FileScan::markDirty()
 {
-  curDirtyFlag = true;
+  filePageIter.markDirty();
 }
 
 }
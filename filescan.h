@@ -9,14 +9,150 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include "types.h"
 #include "page.h"
 #include "buffer.h"
-#include "file_iterator.h"
+#include "buf_file_iterator.h"
 #include "page_iterator.h"
 
 namespace badgerdb {
 
+/**
+ * @brief Comparison of one attribute of a record with a constant, tested in place on the record's page.
+ * Strings are compared as fields of a fixed number of characters, padded with NULs.
+ */
+class ScanPredicate
+{
+ public:
+  ScanPredicate(const int attrByteOffset, const Operator op, const int value);
+  ScanPredicate(const int attrByteOffset, const Operator op, const double value);
+  //attrLength is the number of characters of the string field
+  ScanPredicate(const int attrByteOffset, const Operator op, const std::string& value, const int attrLength);
+
+  //true if the attribute of the record compares with the constant as the operator says; records too
+  //short to hold the attribute never match
+  bool matches(const RecordView& record) const;
+
+ private:
+  /**
+   * Byte offset of the attribute in the record
+   */
+  int attrByteOffset;
+
+  /**
+   * Number of bytes of the attribute
+   */
+  int attrLength;
+
+  /**
+   * Type of the attribute
+   */
+  Datatype type;
+
+  /**
+   * Comparison of the attribute with the constant
+   */
+  Operator op;
+
+  /**
+   * The constant, of the attribute's type
+   */
+  int intValue;
+  double doubleValue;
+  std::string stringValue;
+};
+
+/**
+ * @brief Bytes of a record kept by the projection of a FileScan
+ */
+struct ScanAttribute
+{
+  /**
+   * Byte offset of the attribute in the record
+   */
+  int attrByteOffset;
+
+  /**
+   * Number of bytes of the attribute
+   */
+  int attrLength;
+};
+
+/**
+ * @brief Default number of records in a RecordBatch.
+ */
+const std::size_t RECORDBATCHSIZE = 1024;
+
+/**
+ * @brief Records returned together by FileScan::nextBatch. Each record is copied next to the one before
+ * it into a buffer the batch reuses, so a batch may hold records of several pages and stays valid after
+ * the scan moves on.
+ */
+class RecordBatch
+{
+ public:
+  RecordBatch(const std::size_t capacity = RECORDBATCHSIZE)
+    : maxRecords(capacity), offsets(1, 0)
+  {
+    rids.reserve(capacity);
+    offsets.reserve(capacity + 1);
+  }
+
+  //number of records in the batch, and the most it holds
+  std::size_t size() const { return rids.size(); }
+  std::size_t capacity() const { return maxRecords; }
+
+  //id of the i-th record
+  const RecordId& getRecordId(const std::size_t i) const { return rids[i]; }
+
+  //bytes of the i-th record, valid until the batch is filled again
+  RecordView getRecord(const std::size_t i) const
+  {
+    return RecordView(bytes.data() + offsets[i], offsets[i + 1] - offsets[i]);
+  }
+
+  //empty the batch, keeping the memory it uses
+  void clear()
+  {
+    rids.clear();
+    offsets.resize(1);
+    bytes.clear();
+  }
+
+  //add a copy of a record to the end of the batch
+  void append(const RecordId& rid, const RecordView& record)
+  {
+    rids.push_back(rid);
+    bytes.append(record.data(), record.size());
+    offsets.push_back(bytes.size());
+  }
+
+  //add a copy of the given attributes of a record to the end of the batch
+  void append(const RecordId& rid, const RecordView& record, const std::vector<ScanAttribute>& attributes);
+
+ private:
+  /**
+   * Most records the batch holds
+   */
+  std::size_t maxRecords;
+
+  /**
+   * Ids of the records
+   */
+  std::vector<RecordId> rids;
+
+  /**
+   * Offset of each record in bytes, followed by the offset of the end of the last record
+   */
+  std::vector<std::size_t> offsets;
+
+  /**
+   * Bytes of the records, one after another
+   */
+  std::string bytes;
+};
+
 /**
  * @brief This class is used to sequentially scan records in a relation.
  */
@@ -24,16 +160,39 @@ class FileScan
 {
  public:
 
-  FileScan(const std::string &name, BufMgr *bufMgr);
+  //ringSize is the number of frames the scan reads its pages into and reuses, so that it does not
+  //replace the rest of the buffer pool; 0 reads them into frames chosen by the buffer manager
+  FileScan(const std::string &name, BufMgr *bufMgr, const std::uint32_t ringSize = BUFRINGSIZE);
 
   ~FileScan();
 
   //return RecordId of next record that satisfies the scan 
   void scanNext(RecordId& outRid);
 
+  //as scanNext, but returns false instead of throwing EndOfFileException at the end of the file
+  bool tryScanNext(RecordId& outRid);
+
+  //fill the batch with the next records that satisfy the scan, up to its capacity, projected if a
+  //projection was set; returns false once no records are left
+  bool nextBatch(RecordBatch& batch);
+
   //read current record, returning pointer and length
   std::string getRecord();
 
+  //read current record in place in its page, without copying it; the view is valid until the scan moves on
+  RecordView getRecordView();
+
+  //only return records for which the predicate holds, along with every predicate added before;
+  //predicates are tested in place on the page, so records that fail them are never copied
+  void addPredicate(const ScanPredicate& predicate);
+
+  //keep only the given attributes of each record, in the order given, for getProjectedRecord
+  void setProjection(const std::vector<ScanAttribute>& attributes);
+
+  //read the projected attributes of the current record, or the whole record if no projection was
+  //set; the bytes are kept in a buffer the scan reuses, and are valid until the scan moves on
+  const std::string& getProjectedRecord();
+
   //marks current page of scan dirty
   void markDirty();
 
@@ -49,17 +208,50 @@ class FileScan
 	BufMgr				*bufMgr;
 
   /**
-   * Current page being scanned.
+   * Frames the pages of the scan are read into, or NULL
+   */
+  BufRing*      ring;
+
+  /**
+   * Number of pages asked to be read ahead of the current page
    */
-  Page*         curPage;
+  std::uint32_t prefetchDepth;
 
-  FileIterator  filePageIter;
+  /**
+   * True once the first page of the file has been read
+   */
+  bool          scanStarted;
+
+  /**
+   * Current page being scanned, pinned in the buffer pool
+   */
+  BufFileIterator filePageIter;
   PageIterator  pageRecordIter;
 
   /**
-   * True if page has been updated
+   * Predicates every record returned satisfies
+   */
+  std::vector<ScanPredicate> predicates;
+
+  /**
+   * Attributes kept by the projection, or empty to keep the whole record
+   */
+  std::vector<ScanAttribute> projection;
+
+  /**
+   * Projected attributes of the current record
+   */
+  std::string projectedRecord;
+
+  /**
+   * Ask for the pages after the current one to be read ahead
+   */
+  void readAhead();
+
+  /**
+   * Move on to the next record of the file, whether or not it satisfies the predicates
    */
-  bool  	      curDirtyFlag;
+  bool nextRecord(RecordId& outRid);
 };
 
 }
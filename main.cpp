@@ -6,12 +6,21 @@
  */
 
 #include <vector>
+#include <algorithm>
+#include <map>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <thread>
 #include "btree.h"
 #include "page.h"
 #include "filescan.h"
+#include "parallelscan.h"
 #include "page_iterator.h"
 #include "file_iterator.h"
-#include "exceptions/insufficient_space_exception.h"
+#include "buf_file_iterator.h"
 #include "exceptions/index_scan_completed_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/no_such_key_found_exception.h"
@@ -19,6 +28,11 @@
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/hash_already_present_exception.h"
+#include "exceptions/hash_not_found_exception.h"
+#include "exceptions/invalid_page_exception.h"
+#include "exceptions/bad_index_info_exception.h"
+#include "exceptions/bad_file_format_exception.h"
 
 #define checkPassFail(a, b) 																				\
 {																																		\
@@ -68,11 +82,57 @@ void createRelationBackward();
 void createRelationRandom();
 void intTests();
 int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp);
+int intLookup(BTreeIndex *index, int key);
+int intLookupMany(BTreeIndex *index, int lowVal, int highVal, int step);
+int intDelete(BTreeIndex *index, int lowVal, int highVal);
+void doubleTests();
+int doubleScan(BTreeIndex *index, double lowVal, Operator lowOp, double highVal, Operator highOp);
+void stringTests();
+int stringScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp);
+int scanAll(BTreeIndex *index, const void *lowVal, Operator lowOp, const void *highVal, Operator highOp);
 void indexTests();
 void test1();
 void test2();
 void test3();
 void errorTests();
+int indexReopenCheck(const std::string &name, int numRecords);
+void bufMgrTests();
+int bufMgrStress(PageFile *file, int numPages, int numThreads, int opsPerThread, ReplacementPolicy policy);
+int bufFreedPageStress(int numPages, int numThreads, int opsPerThread, ReplacementPolicy policy);
+void bufPolicyTraces(PageFile *file, int numPages);
+int bufRingHotMisses(PageFile *file, int numPages, std::uint32_t ringSize);
+int bufPrefetchCheck(PageFile *file, int numPages);
+int bufWriterCheck(PageFile *file, int numPages);
+int bufFileIteratorCheck(PageFile *file, int numPages);
+void bufMgrThroughput(PageFile *file, int numPages);
+int bufHashTblCheck(PageFile *fileA, PageFile *fileB, int numOps);
+void bufHashTblThroughput(PageFile *fileA, PageFile *fileB);
+void fileThroughput(const std::string &filename, int numPages, bool direct);
+void fstreamThroughput(const std::string &filename, int numPages);
+int fileFormatCheck(const std::string &filename);
+int pageFileCheck(const std::string &filename, int numPages, bool mapped);
+void createRelationOfSize(const std::string &name, int numRecords);
+void mappedThroughput(int numRecords, int numLookups);
+int pageRecordCheck(int numRounds);
+int scanCount(BufMgr *pool, const std::vector<ScanPredicate> &predicates);
+int scanPushdownCheck(int numRecords);
+int scanBatchCheck(int numRecords);
+int parallelScanCheck(int numRecords);
+int parallelBuildCheck(int numRecords);
+void indexChecks();
+template <class T>
+int nodeSearchErrors(const std::vector<T> &keys, int lowVal, int highVal);
+int nodeSearchCheck();
+void nodeSearchThroughput(int numLookups);
+template <class K>
+int indexContentsCheck(BTreeIndex *index, const std::map<K, RecordId> &expected, const std::vector<K> &probes,
+		const void *lowVal, const void *highVal);
+int stringPrefixCheck(int numKeys);
+int lookupManyCheck(int numKeys, int numDups);
+template <class T>
+int rootLevel(const std::string &indexName);
+template <class K, class T>
+int deleteCheck(int numRecords, int attrByteOffset, Datatype attrType, const K &low, const K &high);
 void deleteRelation();
 
 int main(int argc, char **argv)
@@ -111,6 +171,9 @@ int main(int argc, char **argv)
 
 	{
 		FileScan fscan(relationName, bufMgr);
+		//Assuming RECORD.i is our key, lets project the records onto it, which we know is INTEGER and whose byte offset is also know inside the record. 
+		ScanAttribute keyAttr = { offsetof (RECORD, i), sizeof(int) };
+		fscan.setProjection(std::vector<ScanAttribute>(1, keyAttr));
 
 		try
 		{
@@ -118,10 +181,8 @@ int main(int argc, char **argv)
 			while(1)
 			{
 				fscan.scanNext(scanRid);
-				//Assuming RECORD.i is our key, lets extract the key, which we know is INTEGER and whose byte offset is also know inside the record. 
-				std::string recordStr = fscan.getRecord();
-				const char *record = recordStr.c_str();
-				int key = *((int *)(record + offsetof (RECORD, i)));
+				int key;
+				memcpy(&key, fscan.getProjectedRecord().data(), sizeof(key));
 				std::cout << "Extracted : " << key << std::endl;
 			}
 		}
@@ -138,6 +199,8 @@ int main(int argc, char **argv)
 	test2();
 	test3();
 	errorTests();
+	indexChecks();
+	bufMgrTests();
 
 	delete bufMgr;
 
@@ -208,18 +271,11 @@ void createRelationForward()
     record1.d = (double)i;
     std::string new_data(reinterpret_cast<char*>(&record1), sizeof(record1));
 
-		while(1)
+		if (!new_page.tryInsertRecord(new_data, rid))
 		{
-			try
-			{
-    		new_page.insertRecord(new_data);
-				break;
-			}
-			catch(const InsufficientSpaceException &e)
-			{
-				file1->writePage(new_page_number, new_page);
-  			new_page = file1->allocatePage(new_page_number);
-			}
+			file1->writePage(new_page_number, new_page);
+			new_page = file1->allocatePage(new_page_number);
+			new_page.insertRecord(new_data);
 		}
   }
 
@@ -256,18 +312,11 @@ void createRelationBackward()
 
     std::string new_data(reinterpret_cast<char*>(&record1), sizeof(RECORD));
 
-		while(1)
+		if (!new_page.tryInsertRecord(new_data, rid))
 		{
-			try
-			{
-    		new_page.insertRecord(new_data);
-				break;
-			}
-			catch(const InsufficientSpaceException &e)
-			{
-				file1->writePage(new_page_number, new_page);
-  			new_page = file1->allocatePage(new_page_number);
-			}
+			file1->writePage(new_page_number, new_page);
+			new_page = file1->allocatePage(new_page_number);
+			new_page.insertRecord(new_data);
 		}
   }
 
@@ -316,18 +365,11 @@ void createRelationRandom()
 
     std::string new_data(reinterpret_cast<char*>(&record1), sizeof(RECORD));
 
-		while(1)
+		if (!new_page.tryInsertRecord(new_data, rid))
 		{
-			try
-			{
-    		new_page.insertRecord(new_data);
-				break;
-			}
-			catch(const InsufficientSpaceException &e)
-			{
-      	file1->writePage(new_page_number, new_page);
-  			new_page = file1->allocatePage(new_page_number);
-			}
+			file1->writePage(new_page_number, new_page);
+			new_page = file1->allocatePage(new_page_number);
+			new_page.insertRecord(new_data);
 		}
 
 		int temp = intvec[relationSize-1-i];
@@ -353,6 +395,24 @@ void indexTests()
   catch(const FileNotFoundException &e)
   {
   }
+
+  doubleTests();
+	try
+	{
+		File::remove(doubleIndexName);
+	}
+  catch(const FileNotFoundException &e)
+  {
+  }
+
+  stringTests();
+	try
+	{
+		File::remove(stringIndexName);
+	}
+  catch(const FileNotFoundException &e)
+  {
+  }
 }
 
 // -----------------------------------------------------------------------------
@@ -372,24 +432,166 @@ void intTests()
 	checkPassFail(intScan(&index,0,GT,1,LT), 0)
 	checkPassFail(intScan(&index,300,GT,400,LT), 99)
 	checkPassFail(intScan(&index,3000,GTE,4000,LT), 1000)
+	checkPassFail(intLookup(&index,42), 1)
+	checkPassFail(intLookup(&index,relationSize), 0)
+	checkPassFail(intLookupMany(&index,-10,7000,7), 714)
+	checkPassFail(intDelete(&index,1000,3000), 2000)
+	checkPassFail(intDelete(&index,1000,3000), 0)
+	checkPassFail(intScan(&index,25,GT,40,LT), 14)
+	checkPassFail(intScan(&index,900,GTE,3100,LT), 200)
+	checkPassFail(intLookup(&index,1500), 0)
 }
 
 int intScan(BTreeIndex * index, int lowVal, Operator lowOp, int highVal, Operator highOp)
 {
-  RecordId scanRid;
-	Page *curPage;
+  std::cout << "Scan for ";
+  if( lowOp == GT ) { std::cout << "("; } else { std::cout << "["; }
+  std::cout << lowVal << "," << highVal;
+  if( highOp == LT ) { std::cout << ")"; } else { std::cout << "]"; }
+  std::cout << std::endl;
+
+	return scanAll(index, &lowVal, lowOp, &highVal, highOp);
+}
+
+int intLookup(BTreeIndex * index, int key)
+{
+  std::cout << "Lookup " << key << std::endl;
+
+  std::vector<RecordId> rids;
+  index->lookup(&key, rids);
+	return rids.size();
+}
+
+// Look up every step-th key in [lowVal,highVal) in one batch, passed in descending order, and
+// count the keys that were found along with the right record.
+int intLookupMany(BTreeIndex * index, int lowVal, int highVal, int step)
+{
+  std::cout << "Lookup every " << step << "th key in [" << lowVal << "," << highVal << ")" << std::endl;
+
+  std::vector<int> keys;
+  for (int key = lowVal; key < highVal; key += step)
+    keys.push_back(key);
+  std::vector<const void*> keyPtrs;
+  for (int i = keys.size() - 1; i >= 0; i--)
+    keyPtrs.push_back(&keys[i]);
+
+  std::vector<std::vector<RecordId> > rids;
+  index->lookupMany(keyPtrs, rids);
+
+  int numFound = 0;
+  for (size_t i = 0; i < keyPtrs.size(); i++)
+  {
+    if (rids[i].size() != 1)
+      continue;
+    Page *curPage;
+    bufMgr->readPage(file1, rids[i][0].page_number, curPage);
+    RECORD myRec = *(reinterpret_cast<const RECORD*>(curPage->getRecord(rids[i][0]).data()));
+    bufMgr->unPinPage(file1, rids[i][0].page_number, false);
+    if (myRec.i == *(const int*)keyPtrs[i])
+      numFound++;
+  }
+	return numFound;
+}
+
+// Delete the entries with keys in [lowVal,highVal), finding their record ids by lookup, and
+// return the number deleted.
+int intDelete(BTreeIndex * index, int lowVal, int highVal)
+{
+  std::cout << "Delete [" << lowVal << "," << highVal << ")" << std::endl;
+
+  int numDeleted = 0;
+  for (int key = lowVal; key < highVal; key++)
+  {
+    std::vector<RecordId> rids;
+    index->lookup(&key, rids);
+    for (size_t i = 0; i < rids.size(); i++)
+    {
+      if (index->deleteEntry(&key, rids[i]))
+        numDeleted++;
+    }
+  }
+	return numDeleted;
+}
+
+// -----------------------------------------------------------------------------
+// doubleTests
+// -----------------------------------------------------------------------------
+
+void doubleTests()
+{
+  std::cout << "Create a B+ Tree index on the double field" << std::endl;
+  BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple,d), DOUBLE);
 
+	// run some tests
+	checkPassFail(doubleScan(&index,25,GT,40,LT), 14)
+	checkPassFail(doubleScan(&index,20,GTE,35,LTE), 16)
+	checkPassFail(doubleScan(&index,-3,GT,3,LT), 3)
+	checkPassFail(doubleScan(&index,996,GT,1001,LT), 4)
+	checkPassFail(doubleScan(&index,0,GT,1,LT), 0)
+	checkPassFail(doubleScan(&index,300,GT,400,LT), 99)
+	checkPassFail(doubleScan(&index,3000,GTE,4000,LT), 1000)
+}
+
+int doubleScan(BTreeIndex * index, double lowVal, Operator lowOp, double highVal, Operator highOp)
+{
   std::cout << "Scan for ";
   if( lowOp == GT ) { std::cout << "("; } else { std::cout << "["; }
   std::cout << lowVal << "," << highVal;
   if( highOp == LT ) { std::cout << ")"; } else { std::cout << "]"; }
   std::cout << std::endl;
 
+	return scanAll(index, &lowVal, lowOp, &highVal, highOp);
+}
+
+// -----------------------------------------------------------------------------
+// stringTests
+// -----------------------------------------------------------------------------
+
+void stringTests()
+{
+  std::cout << "Create a B+ Tree index on the string field" << std::endl;
+  BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple,s), STRING);
+
+	// run some tests
+	checkPassFail(stringScan(&index,25,GT,40,LT), 14)
+	checkPassFail(stringScan(&index,20,GTE,35,LTE), 16)
+	checkPassFail(stringScan(&index,-3,GT,3,LT), 3)
+	checkPassFail(stringScan(&index,996,GT,1001,LT), 4)
+	checkPassFail(stringScan(&index,0,GT,1,LT), 0)
+	checkPassFail(stringScan(&index,300,GT,400,LT), 99)
+	checkPassFail(stringScan(&index,3000,GTE,4000,LT), 1000)
+}
+
+int stringScan(BTreeIndex * index, int lowVal, Operator lowOp, int highVal, Operator highOp)
+{
+  char lowValStr[100];
+  char highValStr[100];
+  sprintf(lowValStr,"%05d string record",lowVal);
+  sprintf(highValStr,"%05d string record",highVal);
+
+  std::cout << "Scan for ";
+  if( lowOp == GT ) { std::cout << "("; } else { std::cout << "["; }
+  std::cout << lowValStr << "," << highValStr;
+  if( highOp == LT ) { std::cout << ")"; } else { std::cout << "]"; }
+  std::cout << std::endl;
+
+	return scanAll(index, lowValStr, lowOp, highValStr, highOp);
+}
+
+// -----------------------------------------------------------------------------
+// scanAll
+// -----------------------------------------------------------------------------
+
+int scanAll(BTreeIndex * index, const void *lowVal, Operator lowOp, const void *highVal, Operator highOp)
+{
+  RecordId scanRid;
+	Page *curPage;
+
   int numResults = 0;
 	
 	try
 	{
-  	index->startScan(&lowVal, lowOp, &highVal, highOp);
+  	index->startScan(lowVal, lowOp, highVal, highOp);
 	}
 	catch(const NoSuchKeyFoundException &e)
 	{
@@ -468,18 +670,11 @@ void errorTests()
 		  record1.d = (double)i;
 		  std::string new_data(reinterpret_cast<char*>(&record1), sizeof(record1));
 
-			while(1)
+			if (!new_page.tryInsertRecord(new_data, rid))
 			{
-				try
-				{
-		  		new_page.insertRecord(new_data);
-					break;
-				}
-				catch(const InsufficientSpaceException &e)
-				{
-					file1->writePage(new_page_number, new_page);
-					new_page = file1->allocatePage(new_page_number);
-				}
+				file1->writePage(new_page_number, new_page);
+				new_page = file1->allocatePage(new_page_number);
+				new_page.insertRecord(new_data);
 			}
 		}
 
@@ -558,21 +753,1660 @@ void errorTests()
   catch(const FileNotFoundException &e)
   {
   }
+
+	// the meta page keeps only the start of a long relation name
+	checkPassFail(indexReopenCheck("relationWithALongerName", 1000), 0)
 }
 
-void deleteRelation()
+int indexReopenCheck(const std::string &name, int numRecords)
 {
-	if(file1)
+	// build an index, then open it again as the same index and as one on another type of attribute
+	int errors = 0;
+	BufMgr pool(100);
+	std::string indexName;
+	createRelationOfSize(name, numRecords);
 	{
-		bufMgr->flushFile(file1);
-		delete file1;
-		file1 = NULL;
+		BTreeIndex index(name, indexName, &pool, offsetof(RECORD, i), INTEGER);
 	}
+
 	try
 	{
-		File::remove(relationName);
+		BTreeIndex index(name, indexName, &pool, offsetof(RECORD, i), INTEGER);
+		int key = numRecords / 2;
+		std::vector<RecordId> rids;
+		index.lookup(&key, rids);
+		if (rids.size() != 1)
+			errors++;
+	}
+	catch(const BadIndexInfoException &e)
+	{
+		errors++;
+	}
+
+	try
+	{
+		BTreeIndex index(name, indexName, &pool, offsetof(RECORD, i), DOUBLE);
+		errors++;
+	}
+	catch(const BadIndexInfoException &e)
+	{
+	}
+
+	// the refused index has let go of its file, and opens again as what it is
+	try
+	{
+		BTreeIndex index(name, indexName, &pool, offsetof(RECORD, i), INTEGER);
+		int key = numRecords - 1;
+		std::vector<RecordId> rids;
+		index.lookup(&key, rids);
+		if (rids.size() != 1)
+			errors++;
+	}
+	catch(const BadIndexInfoException &e)
+	{
+		errors++;
+	}
+
+	File::remove(indexName);
+	File::remove(name);
+	return errors;
+}
+
+void createRelationOfSize(const std::string &name, int numRecords)
+{
+	// records valued 0 to numRecords in order, filling each page before the next is allocated
+	PageFile relation = PageFile::create(name);
+	PageId pageNo;
+	Page page = relation.allocatePage(pageNo);
+	memset(record1.s, ' ', sizeof(record1.s));
+	for (int i = 0; i < numRecords; i++)
+	{
+		sprintf(record1.s, "%05d string record", i);
+		record1.i = i;
+		record1.d = (double)i;
+		std::string data(reinterpret_cast<char*>(&record1), sizeof(record1));
+		if (!page.tryInsertRecord(data, rid))
+		{
+			relation.writePage(pageNo, page);
+			page = relation.allocatePage(pageNo);
+			page.insertRecord(data);
+		}
+	}
+	relation.writePage(pageNo, page);
+}
+
+// -----------------------------------------------------------------------------
+// bufMgrTests
+// -----------------------------------------------------------------------------
+
+void bufMgrTests()
+{
+	// Read pages of a file from several threads at once through a pool much smaller than the file,
+	// then measure how reads of pages already in the pool scale with the number of threads
+	std::cout << "---------------------" << std::endl;
+	std::cout << "bufMgrTests" << std::endl;
+
+	const std::string bufFileName = "bufTest";
+	const int numPages = 400;
+	try
+	{
+		File::remove(bufFileName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+
+	{
+		PageFile bufFile = PageFile::create(bufFileName);
+		for (int i = 0; i < numPages; i++)
+		{
+			PageId pageNo;
+			Page page = bufFile.allocatePage(pageNo);
+			page.insertRecord(bufFileName);
+			bufFile.writePage(pageNo, page);
+		}
+
+		checkPassFail(bufMgrStress(&bufFile, numPages, 8, 20000, CLOCK), 0)
+		checkPassFail(bufMgrStress(&bufFile, numPages, 8, 20000, TWO_Q), 0)
+		checkPassFail(bufMgrStress(&bufFile, numPages, 8, 20000, ARC), 0)
+		checkPassFail(bufFreedPageStress(numPages, 8, 20000, TWO_Q), 0)
+		checkPassFail(bufFreedPageStress(numPages, 8, 20000, ARC), 0)
+		bufPolicyTraces(&bufFile, numPages);
+		checkPassFail(bufRingHotMisses(&bufFile, numPages, BUFRINGSIZE), 0)
+		std::cout << "hot page misses during a scan without a ring: " << bufRingHotMisses(&bufFile, numPages, 0) << std::endl;
+		checkPassFail(bufPrefetchCheck(&bufFile, numPages), 0)
+		checkPassFail(bufWriterCheck(&bufFile, numPages), 0)
+		checkPassFail(bufFileIteratorCheck(&bufFile, numPages), 0)
+		bufMgrThroughput(&bufFile, numPages);
+
+		// the hash table only needs a second file to tell entries apart
+		PageFile otherFile = PageFile::create(relationName);
+		checkPassFail(bufHashTblCheck(&bufFile, &otherFile, 200000), 0)
+		bufHashTblThroughput(&bufFile, &otherFile);
+	}
+
+	File::remove(bufFileName);
+	File::remove(relationName);
+
+	fstreamThroughput(bufFileName, 2000);
+	fileThroughput(bufFileName, 2000, false);
+	fileThroughput(bufFileName, 2000, true);
+	checkPassFail(fileFormatCheck(bufFileName), 0)
+	checkPassFail(pageFileCheck(bufFileName, 5000, false), 0)
+	checkPassFail(pageFileCheck(bufFileName, 5000, true), 0)
+	mappedThroughput(100000, 20000);
+	checkPassFail(pageRecordCheck(20000), 0)
+	checkPassFail(scanPushdownCheck(100000), 0)
+	checkPassFail(scanBatchCheck(100000), 0)
+	checkPassFail(parallelScanCheck(100000), 0)
+	checkPassFail(parallelBuildCheck(100000), 0)
+}
+
+int bufMgrStress(PageFile *file, int numPages, int numThreads, int opsPerThread, ReplacementPolicy policy)
+{
+	BufMgr pool(64, policy);
+	std::atomic<int> errors(0);
+	std::vector<std::thread> threads;
+
+	for (int t = 0; t < numThreads; t++)
+	{
+		threads.push_back(std::thread([&, t]()
+		{
+			std::mt19937 gen(t);
+			std::uniform_int_distribution<int> dist(1, numPages);
+			for (int i = 0; i < opsPerThread; i++)
+			{
+				PageId pageNo = dist(gen);
+				try
+				{
+					Page *page;
+					pool.readPage(file, pageNo, page);
+					if (page->page_number() != pageNo)
+						errors++;
+					pool.unPinPage(file, pageNo, i % 8 == 0);
+				}
+				catch(...)
+				{
+					errors++;
+				}
+			}
+		}));
+	}
+	for (size_t t = 0; t < threads.size(); t++)
+		threads[t].join();
+
+	pool.flushFile(file);
+	return errors;
+}
+
+int bufFreedPageStress(int numPages, int numThreads, int opsPerThread, ReplacementPolicy policy)
+{
+	// half the threads read deleted pages, which fail after a frame was taken for them, while the others
+	// read and change pages of the same file through a pool small enough that every read replaces a page
+	const std::string freedFileName = "bufFreed";
+	try
+	{
+		File::remove(freedFileName);
 	}
 	catch(const FileNotFoundException &e)
 	{
 	}
+
+	std::atomic<int> errors(0);
+	{
+		PageFile file = PageFile::create(freedFileName);
+		for (int i = 0; i < numPages; i++)
+		{
+			PageId pageNo;
+			Page page = file.allocatePage(pageNo);
+			page.insertRecord(freedFileName);
+			file.writePage(pageNo, page);
+		}
+		for (PageId pageNo = 1; pageNo <= (PageId)numPages; pageNo += 4)
+			file.deletePage(pageNo);
+
+		BufMgr pool(16, policy);
+		std::vector<std::thread> threads;
+		for (int t = 0; t < numThreads; t++)
+		{
+			threads.push_back(std::thread([&, t]()
+			{
+				std::mt19937 gen(t);
+				std::uniform_int_distribution<int> dist(0, numPages / 4 - 1);
+				for (int i = 0; i < opsPerThread; i++)
+				{
+					// pages 4k + 1 are deleted
+					PageId pageNo = 4 * dist(gen) + (t % 2 == 0 ? 1 : 2 + i % 3);
+					try
+					{
+						Page *page;
+						pool.readPage(&file, pageNo, page);
+						if (t % 2 == 0 || page->page_number() != pageNo)
+							errors++;
+						pool.unPinPage(&file, pageNo, i % 8 == 0);
+					}
+					catch(const InvalidPageException &)
+					{
+						if (t % 2 != 0)
+							errors++;
+					}
+					catch(...)
+					{
+						errors++;
+					}
+				}
+			}));
+		}
+		for (size_t t = 0; t < threads.size(); t++)
+			threads[t].join();
+		pool.flushFile(&file);
+	}
+
+	File::remove(freedFileName);
+	return errors;
+}
+
+void bufPolicyTraces(PageFile *file, int numPages)
+{
+	// Replay the same page requests through a pool a tenth the size of the file under each policy. The
+	// first trace mixes lookups into a small set of hot pages with a scan of the whole file, as when a
+	// FileScan runs beside index lookups; the second is skewed towards the first pages of the file.
+	const int numRequests = 200000;
+	const int hotPages = numPages / 15;
+	std::vector<PageId> scanTrace, skewedTrace;
+	std::mt19937 gen(3);
+	std::uniform_real_distribution<double> uniform(0, 1);
+	PageId scanPageNo = hotPages;
+	for (int i = 0; i < numRequests; i++)
+	{
+		if (i % 4 == 3)
+		{
+			scanPageNo = scanPageNo % numPages + 1;
+			scanTrace.push_back(scanPageNo);
+		}
+		else
+			scanTrace.push_back(gen() % hotPages + 1);
+
+		double u = uniform(gen);
+		skewedTrace.push_back((PageId)(numPages * u * u * u) + 1);
+	}
+
+	const char *policyNames[] = { "CLOCK", "2Q", "ARC" };
+	const ReplacementPolicy policies[] = { CLOCK, TWO_Q, ARC };
+	const std::vector<PageId> *traces[] = { &scanTrace, &skewedTrace };
+	const char *traceNames[] = { "hot pages + scan", "skewed" };
+	for (int t = 0; t < 2; t++)
+	{
+		for (int p = 0; p < 3; p++)
+		{
+			BufMgr pool(numPages / 10, policies[p]);
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (size_t i = 0; i < traces[t]->size(); i++)
+			{
+				Page *page;
+				pool.readPage(file, (*traces[t])[i], page);
+				pool.unPinPage(file, (*traces[t])[i], false);
+			}
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			BufStats &stats = pool.getBufStats();
+			std::cout << traceNames[t] << ", " << policyNames[p] << ": hit ratio "
+				<< 1.0 - (double)stats.diskreads / stats.accesses << ", "
+				<< (long)(seconds * 1e9 / traces[t]->size()) << " ns/request" << std::endl;
+		}
+	}
+}
+
+int bufRingHotMisses(PageFile *file, int numPages, std::uint32_t ringSize)
+{
+	// bring a set of hot pages into a pool a tenth the size of the file, then scan the whole
+	// file while looking up one of the hot pages per record, and count the lookups that missed.
+	// The hot pages and the ring fit in the pool together.
+	const int hotPages = numPages / 20;
+	BufMgr pool(numPages / 10);
+	for (int i = 1; i <= hotPages; i++)
+	{
+		Page *page;
+		pool.readPage(file, i, page);
+		pool.unPinPage(file, i, false);
+	}
+
+	int misses = 0;
+	FileScan fscan(file->filename(), &pool, ringSize);
+	RecordId scanRid;
+	for (int i = 0; fscan.tryScanNext(scanRid); i++)
+	{
+		Page *page;
+		PageId pageNo = i % hotPages + 1;
+		if (!pool.tryReadPage(file, pageNo, page))
+		{
+			misses++;
+			pool.readPage(file, pageNo, page);
+		}
+		pool.unPinPage(file, pageNo, false);
+	}
+	return misses;
+}
+
+int bufPrefetchCheck(PageFile *file, int numPages)
+{
+	// read half the file ahead while reading all of it in order. Every page must be read from the
+	// file once, whether ahead or on request, and read ahead pages must not count as accesses.
+	BufMgr pool(numPages);
+	pool.prefetchChain(file, 1, numPages / 2);
+
+	int errors = 0;
+	for (int i = 1; i <= numPages; i++)
+	{
+		Page *page;
+		pool.readPage(file, i, page);
+		if (*page->begin() != file->filename())
+			errors++;
+		pool.unPinPage(file, i, false);
+	}
+
+	BufStats &stats = pool.getBufStats();
+	if (stats.diskreads != numPages || stats.accesses != numPages)
+		errors++;
+	pool.flushFile(file);
+	return errors;
+}
+
+int bufFileIteratorCheck(PageFile *file, int numPages)
+{
+	// walk the pages through the buffer pool. They must come in the order of the file's page list,
+	// each read from the file once and unpinned once the iterator moves on.
+	BufMgr pool(numPages);
+	int errors = 0;
+	FileIterator fileIter = file->begin();
+	{
+		BufFileIterator iter(file, &pool);
+		for (; !iter.atEnd(); ++iter, ++fileIter)
+		{
+			if (fileIter == file->end() || iter.getCurrentPageNumber() != fileIter.getCurrentPageNumber() ||
+					*iter->begin() != file->filename())
+				errors++;
+		}
+		if (fileIter != file->end())
+			errors++;
+	}
+
+	BufStats &stats = pool.getBufStats();
+	if (stats.diskreads != numPages)
+		errors++;
+	// every page is unpinned, so the file can be flushed
+	pool.flushFile(file);
+	return errors;
+}
+
+int bufWriterCheck(PageFile *file, int numPages)
+{
+	// dirty every page, then give the background writer time to write them all. Replacing the
+	// pages afterwards must not write any of them again, and their contents must survive.
+	BufMgr pool(numPages / 2);
+	BufStats &stats = pool.getBufStats();
+	for (int i = 1; i <= numPages; i++)
+	{
+		Page *page;
+		pool.readPage(file, i, page);
+		pool.unPinPage(file, i, true);
+		if (i == numPages / 2)
+		{
+			for (int wait = 0; wait < 200 && stats.diskwrites < numPages / 2; wait++)
+				std::this_thread::sleep_for(std::chrono::milliseconds(BUFWRITERINTERVAL));
+		}
+	}
+	int errors = stats.diskwrites < numPages / 2 ? 1 : 0;
+
+	for (int wait = 0; wait < 200 && stats.diskwrites < numPages; wait++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(BUFWRITERINTERVAL));
+	pool.flushFile(file);
+	if (stats.diskwrites != numPages)
+		errors++;
+
+	for (int i = 1; i <= numPages; i++)
+	{
+		if (*file->readPage(i).begin() != file->filename())
+			errors++;
+	}
+	return errors;
+}
+
+void bufMgrThroughput(PageFile *file, int numPages)
+{
+	const int opsPerThread = 200000;
+	BufMgr pool(numPages + 16);
+
+	// bring every page into the pool first, so that only hits are measured
+	for (int i = 1; i <= numPages; i++)
+	{
+		Page *page;
+		pool.readPage(file, i, page);
+		pool.unPinPage(file, i, false);
+	}
+
+	for (int numThreads = 1; numThreads <= 16; numThreads *= 2)
+	{
+		std::vector<std::thread> threads;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int t = 0; t < numThreads; t++)
+		{
+			threads.push_back(std::thread([&, t]()
+			{
+				for (int i = 0; i < opsPerThread; i++)
+				{
+					PageId pageNo = (i * 7 + t * 61) % numPages + 1;
+					Page *page;
+					pool.readPage(file, pageNo, page);
+					pool.unPinPage(file, pageNo, false);
+				}
+			}));
+		}
+		for (size_t t = 0; t < threads.size(); t++)
+			threads[t].join();
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cout << numThreads << " threads: " << (long)(numThreads * opsPerThread / seconds) << " reads/s" << std::endl;
+	}
+
+	pool.flushFile(file);
+}
+
+int bufHashTblCheck(PageFile *fileA, PageFile *fileB, int numOps)
+{
+	// apply random inserts, lookups and removes to a small table and to a std::map, and
+	// count the operations on which they disagree
+	BufHashTbl table(4);
+	std::map<std::pair<File*, PageId>, FrameId> expected;
+	std::mt19937 gen(7);
+	int errors = 0;
+
+	for (int i = 0; i < numOps; i++)
+	{
+		File *file = gen() % 2 ? fileA : fileB;
+		PageId pageNo = gen() % 2000 + 1;
+		std::pair<File*, PageId> key(file, pageNo);
+		bool present = expected.count(key) > 0;
+		FrameId frameNo = 0;
+
+		try
+		{
+			switch (gen() % 3)
+			{
+				case 0:
+					table.insert(file, pageNo, i);
+					expected[key] = i;
+					errors += present;
+					break;
+				case 1:
+					table.lookup(file, pageNo, frameNo);
+					errors += !present || frameNo != expected[key];
+					break;
+				default:
+					table.remove(file, pageNo);
+					expected.erase(key);
+					errors += !present;
+			}
+		}
+		catch(const HashAlreadyPresentException &e)
+		{
+			errors += !present;
+		}
+		catch(const HashNotFoundException &e)
+		{
+			errors += present;
+		}
+	}
+
+	// everything left must still be found
+	for (std::map<std::pair<File*, PageId>, FrameId>::iterator it = expected.begin(); it != expected.end(); ++it)
+	{
+		FrameId frameNo = 0;
+		table.lookup(it->first.first, it->first.second, frameNo);
+		errors += frameNo != it->second;
+	}
+	return errors;
+}
+
+void bufHashTblThroughput(PageFile *fileA, PageFile *fileB)
+{
+	// a pool's worth of pages spread over two files, replaced in the order they came in,
+	// as the clock evicts them
+	const int numEntries = 1024;
+	const int rounds = 1000;
+	std::vector<File*> files(numEntries * (rounds + 1));
+	std::vector<PageId> pageNos(files.size());
+	std::mt19937 gen(11);
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		files[i] = gen() % 2 ? fileA : fileB;
+		pageNos[i] = i + 1;
+	}
+	std::shuffle(pageNos.begin(), pageNos.end(), gen);
+
+	BufHashTbl table(numEntries);
+	for (int i = 0; i < numEntries; i++)
+		table.insert(files[i], pageNos[i], i);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int r = 0; r < rounds; r++)
+	{
+		for (int i = 0; i < numEntries; i++)
+		{
+			FrameId frameNo;
+			table.lookup(files[i], pageNos[i], frameNo);
+		}
+	}
+	double lookupSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	start = std::chrono::steady_clock::now();
+	for (int i = numEntries; i < (int)files.size(); i++)
+	{
+		table.remove(files[i - numEntries], pageNos[i - numEntries]);
+		table.insert(files[i], pageNos[i], i % numEntries);
+	}
+	double updateSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << "hash table lookups: " << (long)(rounds * numEntries / lookupSeconds) << "/s" << std::endl;
+	std::cout << "hash table remove+insert: " << (long)(rounds * numEntries / updateSeconds) << "/s" << std::endl;
+}
+
+void deleteRelation()
+{
+	if(file1)
+	{
+		bufMgr->flushFile(file1);
+		delete file1;
+		file1 = NULL;
+	}
+	try
+	{
+		File::remove(relationName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+}
+
+void fileThroughput(const std::string &filename, int numPages, bool direct)
+{
+	// write every page of a new file in order, then read pages at random, returning copies and in place
+	File::setDirectIO(direct);
+	{
+		BlobFile file = BlobFile::create(filename);
+		Page page;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int i = 0; i < numPages; i++)
+		{
+			PageId pageNo;
+			file.allocatePage(pageNo);
+			file.writePage(pageNo, page);
+		}
+		double writeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		std::mt19937 random(numPages);
+		start = std::chrono::steady_clock::now();
+		for (int i = 0; i < numPages; i++)
+		{
+			page = file.readPage(random() % numPages + 1);
+		}
+		double readSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		// read into a page-aligned frame of a buffer pool, as the buffer manager does
+		BufMgr pool(1);
+		start = std::chrono::steady_clock::now();
+		for (int i = 0; i < numPages; i++)
+		{
+			file.readPage(random() % numPages + 1, pool.bufPool[0]);
+		}
+		double inPlaceSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		std::cout << (direct ? "O_DIRECT" : "buffered") << " file: " << (long)(numPages / writeSeconds) << " page writes/s, "
+			<< (long)(numPages / readSeconds) << " page reads/s, " << (long)(numPages / inPlaceSeconds) << " in place" << std::endl;
+	}
+	File::setDirectIO(false);
+	File::remove(filename);
+}
+
+void fstreamThroughput(const std::string &filename, int numPages)
+{
+	// the same work as fileThroughput, done the way files were read and written before pread and
+	// pwrite: through an fstream, seeking before every call and flushing after every write, with
+	// the header in front of page 1. An allocation wrote the new page and the header.
+	struct OldHeader
+	{
+		PageId num_pages, first_used_page, num_free_pages, first_free_page;
+	};
+	{
+		std::fstream file(filename.c_str(), std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+		OldHeader header = { 1, 0, 0, 0 };
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.flush();
+		auto pagePosition = [](PageId pageNo) { return sizeof(OldHeader) + (pageNo - 1) * Page::SIZE; };
+
+		Page page;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int i = 0; i < numPages; i++)
+		{
+			file.seekg(0, std::ios::beg);
+			file.read(reinterpret_cast<char*>(&header), sizeof(header));
+			const PageId pageNo = header.num_pages++;
+			file.seekp(pagePosition(pageNo), std::ios::beg);
+			file.write(reinterpret_cast<const char*>(&page), Page::SIZE);
+			file.flush();
+			file.seekp(0, std::ios::beg);
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			file.flush();
+
+			file.seekp(pagePosition(pageNo), std::ios::beg);
+			file.write(reinterpret_cast<const char*>(&page), Page::SIZE);
+			file.flush();
+		}
+		double writeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		std::mt19937 random(numPages);
+		start = std::chrono::steady_clock::now();
+		for (int i = 0; i < numPages; i++)
+		{
+			file.seekg(pagePosition(random() % numPages + 1), std::ios::beg);
+			file.read(reinterpret_cast<char*>(&page), Page::SIZE);
+		}
+		double readSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		std::cout << "fstream file: " << (long)(numPages / writeSeconds) << " page writes/s, "
+			<< (long)(numPages / readSeconds) << " page reads/s" << (file ? "" : " (I/O failed)") << std::endl;
+	}
+	File::remove(filename);
+}
+
+int fileFormatCheck(const std::string &filename)
+{
+	// a file in the old fstream layout, with no magic number, must be refused rather than misread,
+	// while a file in the current layout opens again
+	int errors = 0;
+	{
+		std::ofstream old(filename.c_str(), std::ios::binary);
+		PageId header[4] = { 3, 1, 0, 0 };
+		old.write(reinterpret_cast<const char*>(header), sizeof(header));
+		Page page;
+		old.write(reinterpret_cast<const char*>(&page), Page::SIZE);
+		old.write(reinterpret_cast<const char*>(&page), Page::SIZE);
+	}
+	try
+	{
+		PageFile file = PageFile::open(filename);
+		errors++;
+	}
+	catch(const BadFileFormatException &e)
+	{
+	}
+	File::remove(filename);
+
+	PageId pageNo;
+	{
+		PageFile file = PageFile::create(filename);
+		file.allocatePage(pageNo);
+	}
+	try
+	{
+		PageFile file = PageFile::open(filename);
+		if (file.readPage(pageNo).page_number() != pageNo)
+			errors++;
+	}
+	catch(const BadFileFormatException &e)
+	{
+		errors++;
+	}
+	File::remove(filename);
+	return errors;
+}
+
+int pageFileCheck(const std::string &filename, int numPages, bool mapped)
+{
+	// append pages, delete every third and a run of pages, then allocate the same number again.
+	// The used pages must be listed in order throughout, and the freed pages reused lowest first.
+	// A mapped file is mapped again as it grows.
+	int errors = 0;
+	File::setMemoryMapped(mapped);
+	{
+		PageFile file = PageFile::create(filename);
+		if (file.memoryMapped() != mapped)
+			errors++;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int i = 0; i < numPages; i++)
+		{
+			PageId pageNo;
+			file.allocatePage(pageNo);
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "appending " << numPages << " pages to a " << (mapped ? "mapped" : "pread") << " file: "
+			<< (long)(numPages / seconds) << " pages/s" << std::endl;
+
+		std::vector<Page> copies(5);
+		for (int i = 0; i < 5; i++)
+			copies[i] = file.readPage(i + 1);
+
+		std::vector<bool> used(numPages + 1, true);
+		int numDeleted = 0;
+		for (int i = 1; i <= numPages; i++)
+		{
+			if (i % 3 == 0 || (i > numPages / 2 && i <= numPages / 2 + 50))
+			{
+				file.deletePage(i);
+				used[i] = false;
+				numDeleted++;
+			}
+		}
+
+		// the copies read before page 3 was deleted still point to it, which writing them back
+		// must not put on disk, and the copy of page 3 can no longer be written
+		file.writePages(1, &copies[0], 2);
+		file.writePage(4, copies[3]);
+		try
+		{
+			file.writePage(3, copies[2]);
+			errors++;
+		}
+		catch(const InvalidPageException &)
+		{
+		}
+
+		// the used pages are listed in order, each pointing back to the one before it
+		PageId expected = 1;
+		PageId previous = Page::INVALID_NUMBER;
+		for (FileIterator iter = file.begin(); iter != file.end() && expected <= (PageId)numPages + 1; ++iter)
+		{
+			while (expected <= (PageId)numPages && !used[expected])
+				expected++;
+			if (iter.getCurrentPageNumber() != expected++)
+				errors++;
+			if ((*iter).prev_page_number() != previous)
+				errors++;
+			previous = iter.getCurrentPageNumber();
+		}
+
+		PageId lowest = 1;
+		for (int i = 0; i < numDeleted; i++)
+		{
+			while (used[lowest])
+				lowest++;
+			PageId pageNo;
+			file.allocatePage(pageNo);
+			if (pageNo != lowest)
+				errors++;
+			used[lowest] = true;
+		}
+
+		expected = 1;
+		for (FileIterator iter = file.begin(); iter != file.end() && expected <= (PageId)numPages + 1; ++iter)
+		{
+			if (iter.getCurrentPageNumber() != expected++)
+				errors++;
+		}
+		if (expected != (PageId)numPages + 1)
+			errors++;
+		file.sync();
+	}
+	File::setMemoryMapped(false);
+	File::remove(filename);
+	return errors;
+}
+
+// -----------------------------------------------------------------------------
+// indexChecks
+// -----------------------------------------------------------------------------
+
+void indexChecks()
+{
+	checkPassFail(nodeSearchCheck(), 0)
+	nodeSearchThroughput(200000);
+	checkPassFail(stringPrefixCheck(1500), 0)
+	checkPassFail(lookupManyCheck(20000, 300), 0)
+	checkPassFail((deleteCheck<int, int>(20000, offsetof(RECORD, i), INTEGER,
+			std::numeric_limits<int>::min(), std::numeric_limits<int>::max())), 0)
+	checkPassFail((deleteCheck<double, double>(20000, offsetof(RECORD, d), DOUBLE,
+			-std::numeric_limits<double>::max(), std::numeric_limits<double>::max())), 0)
+	checkPassFail((deleteCheck<std::string, StringKey>(20000, offsetof(RECORD, s), STRING,
+			std::string(), std::string(STRINGSIZE, '\xff'))), 0)
+}
+
+template <class T>
+int nodeSearchErrors(const std::vector<T> &keys, int lowVal, int highVal)
+{
+	// every value in [lowVal,highVal] must be placed where the standard library's searches place it
+	int errors = 0;
+	for (int value = lowVal; value <= highVal; value++)
+	{
+		const T key = value;
+		if (lowerBound(keys.data(), keys.size(), key) != std::lower_bound(keys.begin(), keys.end(), key) - keys.begin())
+			errors++;
+		if (upperBound(keys.data(), keys.size(), key) != std::upper_bound(keys.begin(), keys.end(), key) - keys.begin())
+			errors++;
+	}
+	return errors;
+}
+
+int nodeSearchCheck()
+{
+	// search nodes of no keys, a few keys and as many keys as leaves and non-leaves hold, with the
+	// keys all different, each repeated and all the same, for values from below the first key to
+	// above the last
+	int errors = 0;
+	const int sizes[] = { 0, 1, 2, 3, 5, INTARRAYNONLEAFSIZE, INTARRAYLEAFSIZE, DOUBLEARRAYNONLEAFSIZE, DOUBLEARRAYLEAFSIZE };
+	for (std::size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+	{
+		const int n = sizes[s];
+		for (int repeats = 1; repeats <= 3; repeats += 2)
+		{
+			std::vector<int> ints(n);
+			std::vector<double> doubles(n);
+			for (int i = 0; i < n; i++)
+			{
+				ints[i] = 2 * (i / repeats);
+				doubles[i] = ints[i];
+			}
+			errors += nodeSearchErrors(ints, -3, 2 * n + 3);
+			errors += nodeSearchErrors(doubles, -3, 2 * n + 3);
+		}
+		errors += nodeSearchErrors(std::vector<int>(n, 7), 5, 9);
+		errors += nodeSearchErrors(std::vector<double>(n, 7), 5, 9);
+	}
+	return errors;
+}
+
+void nodeSearchThroughput(int numLookups)
+{
+	// look up random keys in a full leaf by scanning its keys in order, as nodes were searched
+	// before, and with the branchless binary search
+	const int n = INTARRAYLEAFSIZE;
+	std::vector<int> keys(n);
+	for (int i = 0; i < n; i++)
+		keys[i] = 2 * i;
+	std::mt19937 random(numLookups);
+	std::vector<int> probes(numLookups);
+	for (int i = 0; i < numLookups; i++)
+		probes[i] = (int)(random() % (2 * n + 2)) - 1;
+
+	long positions = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int i = 0; i < numLookups; i++)
+	{
+		int pos = 0;
+		while (pos < n && keys[pos] < probes[i])
+			pos++;
+		positions += pos;
+	}
+	double linearSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < numLookups; i++)
+		positions -= lowerBound(&keys[0], n, probes[i]);
+	double searchSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << "searching a full leaf: " << (long)(numLookups / linearSeconds) << " linear scans/s, "
+		<< (long)(numLookups / searchSeconds) << " branchless searches/s"
+		<< (positions == 0 ? "" : " (positions differ)") << std::endl;
+}
+
+const void *keyPointer(const std::string &key)
+{
+	return key.c_str();
+}
+
+template <class K>
+const void *keyPointer(const K &key)
+{
+	return &key;
+}
+
+template <class K>
+int indexContentsCheck(BTreeIndex *index, const std::map<K, RecordId> &expected, const std::vector<K> &probes,
+		const void *lowVal, const void *highVal)
+{
+	// a scan of [lowVal,highVal] must return the record ids of the map in key order, and looking up a
+	// probe must find its record id or nothing if the map does not hold it
+	int errors = 0;
+	std::vector<RecordId> scanned;
+	try
+	{
+		index->startScan(lowVal, GTE, highVal, LTE);
+		RecordId scanRid;
+		while (1)
+		{
+			index->scanNext(scanRid);
+			scanned.push_back(scanRid);
+		}
+	}
+	catch (const NoSuchKeyFoundException &e)
+	{
+	}
+	catch (const IndexScanCompletedException &e)
+	{
+		index->endScan();
+	}
+	if (scanned.size() != expected.size())
+		errors++;
+	typename std::map<K, RecordId>::const_iterator entry = expected.begin();
+	for (std::size_t i = 0; i < scanned.size() && entry != expected.end(); i++, ++entry)
+	{
+		if (!(scanned[i] == entry->second))
+			errors++;
+	}
+
+	for (std::size_t i = 0; i < probes.size(); i++)
+	{
+		std::vector<RecordId> found;
+		index->lookup(keyPointer(probes[i]), found);
+		entry = expected.find(probes[i]);
+		if (entry == expected.end() ? !found.empty() : found.size() != 1 || !(found[0] == entry->second))
+			errors++;
+	}
+	return errors;
+}
+
+int stringPrefixCheck(int numKeys)
+{
+	// insert keys into an empty STRING index so that a leaf has to store its keys again under a
+	// shorter prefix, leaves split between keys that differ only in their last bytes and keys that are
+	// prefixes of one another, and then delete the keys in random order. The index must match a sorted
+	// map of the keys after each step.
+	int errors = 0;
+	createRelationOfSize(relationName, 1);
+	BufMgr pool(256);
+	std::string indexName;
+	{
+		BTreeIndex index(relationName, indexName, &pool, offsetof(RECORD, s), STRING);
+		const std::string low, high(STRINGSIZE, '\xff');
+		std::map<std::string, RecordId> expected;
+		std::vector<std::string> keys;
+		std::mt19937 random(numKeys);
+
+		char key[STRINGSIZE + 1];
+		sprintf(key, "%05d string record", 0);
+		std::vector<RecordId> rids;
+		index.lookup(key, rids);
+		if (rids.size() != 1 || !index.deleteEntry(key, rids[0]))
+			errors++;
+
+		// keys that share a long prefix, then keys sharing less and less of it, then more of the first kind
+		std::vector<std::string> batches[4];
+		for (int i = 0; i < numKeys / 5; i++)
+		{
+			sprintf(key, "a-long-prefix-shared-by-every-key-of-the-first-leaf-%04d", i);
+			batches[i < numKeys / 15 ? 0 : 2].push_back(key);
+		}
+		batches[1].push_back("a-long-prefix");
+		batches[1].push_back("a-");
+		batches[1].push_back("b");
+		// keys that only differ in their last bytes, keys that only differ in their last byte, keys
+		// that are prefixes of those, and keys that differ early and then run on the same
+		for (int i = 0; i < numKeys / 2; i++)
+		{
+			sprintf(key, "%s%04d", std::string(STRINGSIZE - 4, 'm').c_str(), i);
+			batches[3].push_back(key);
+		}
+		for (char c = '!'; c <= '~'; c++)
+			batches[3].push_back(std::string(STRINGSIZE - 1, 'q') + c);
+		for (int length = 1; length < STRINGSIZE; length += 6)
+		{
+			batches[3].push_back(std::string(length, 'm'));
+			batches[3].push_back(std::string(length, 'q'));
+		}
+		for (int i = 0; i < numKeys / 4; i++)
+		{
+			sprintf(key, "p%04d%s", i, std::string(STRINGSIZE - 5, 'x').c_str());
+			batches[3].push_back(key);
+		}
+
+		for (int b = 0; b < 4; b++)
+		{
+			std::shuffle(batches[b].begin(), batches[b].end(), random);
+			for (std::size_t i = 0; i < batches[b].size(); i++)
+			{
+				RecordId newRid = { (PageId)(keys.size() / 100 + 2), (SlotId)(keys.size() % 100 + 1), 0 };
+				index.insertEntry(batches[b][i].c_str(), newRid);
+				expected[batches[b][i]] = newRid;
+				keys.push_back(batches[b][i]);
+			}
+
+			std::vector<std::string> probes(keys);
+			for (std::size_t i = 0; i < keys.size(); i++)
+				probes.push_back(keys[i].substr(0, keys[i].size() - 1));
+			errors += indexContentsCheck(&index, expected, probes, low.c_str(), high.c_str());
+		}
+
+		// delete a quarter of the keys at a time
+		std::shuffle(keys.begin(), keys.end(), random);
+		for (std::size_t i = 0; i < keys.size(); i++)
+		{
+			if (!index.deleteEntry(keys[i].c_str(), expected[keys[i]]))
+				errors++;
+			expected.erase(keys[i]);
+			if ((i + 1) % (keys.size() / 4) == 0 || i + 1 == keys.size())
+				errors += indexContentsCheck(&index, expected, keys, low.c_str(), high.c_str());
+		}
+	}
+	File::remove(indexName);
+	File::remove(relationName);
+	return errors;
+}
+
+int lookupManyCheck(int numKeys, int numDups)
+{
+	// index keys repeated over several leaves and look up a batch of them in random order, some twice
+	// and some missing, which must find what looking each key up on its own does while reading fewer pages
+	int errors = 0;
+	createRelationOfSize(relationName, 1);
+	BufMgr pool(256);
+	std::string indexName;
+	{
+		BTreeIndex index(relationName, indexName, &pool, offsetof(RECORD, i), INTEGER);
+		for (int k = 0; k < numKeys; k++)
+		{
+			int key = k / numDups;
+			RecordId newRid = { (PageId)(k / 100 + 2), (SlotId)(k % 100 + 1), 0 };
+			index.insertEntry(&key, newRid);
+		}
+
+		std::vector<int> keys;
+		for (int key = -2; key < numKeys / numDups + 2; key++)
+		{
+			keys.push_back(key);
+			if (key % 3 == 0)
+				keys.push_back(key);
+		}
+		std::shuffle(keys.begin(), keys.end(), std::mt19937(numKeys));
+		std::vector<const void*> keyPtrs;
+		for (std::size_t i = 0; i < keys.size(); i++)
+			keyPtrs.push_back(&keys[i]);
+
+		pool.clearBufStats();
+		std::vector<std::vector<RecordId> > rids;
+		index.lookupMany(keyPtrs, rids);
+		const int manyAccesses = pool.getBufStats().accesses;
+
+		std::vector<std::vector<RecordId> > expected(keys.size());
+		pool.clearBufStats();
+		for (std::size_t i = 0; i < keys.size(); i++)
+			index.lookup(&keys[i], expected[i]);
+		const int singleAccesses = pool.getBufStats().accesses;
+
+		if (rids.size() != keys.size())
+			errors++;
+		for (std::size_t i = 0; i < keys.size() && i < rids.size(); i++)
+		{
+			if (rids[i] != expected[i])
+				errors++;
+		}
+		if (manyAccesses >= singleAccesses)
+			errors++;
+		std::cout << "looking up " << keys.size() << " keys: " << manyAccesses << " pages read in a batch, "
+			<< singleAccesses << " one at a time" << std::endl;
+	}
+	File::remove(indexName);
+	File::remove(relationName);
+	return errors;
+}
+
+template <class T>
+int rootLevel(const std::string &indexName)
+{
+	// level of the root of a closed index, which is 0 when its children are non-leaves too
+	BlobFile file = BlobFile::open(indexName);
+	Page page = file.readPage(file.getFirstPageNo());
+	page = file.readPage(reinterpret_cast<const IndexMetaInfo*>(&page)->rootPageNo);
+	return reinterpret_cast<const NonLeafNode<T>*>(&page)->level;
+}
+
+void recordKey(const RECORD &record, int &key)
+{
+	key = record.i;
+}
+
+void recordKey(const RECORD &record, double &key)
+{
+	key = record.d;
+}
+
+void recordKey(const RECORD &record, std::string &key)
+{
+	key = record.s;
+}
+
+template <class K, class T>
+int deleteCheck(int numRecords, int attrByteOffset, Datatype attrType, const K &low, const K &high)
+{
+	// bulk load an index with nearly empty nodes, so that the tree is several levels deep, and delete
+	// every entry in random order. That merges and redistributes both leaves and non-leaves and takes
+	// the root down level by level. The index must match a map of the entries left after each batch.
+	// Then open the index again and insert the entries back, which must reuse the freed pages.
+	int errors = 0;
+	createRelationOfSize(relationName, numRecords);
+	BufMgr pool(256);
+	std::map<K, RecordId> expected;
+	std::vector<K> keys;
+	{
+		FileScan scan(relationName, &pool);
+		RecordId scanRid;
+		while (scan.tryScanNext(scanRid))
+		{
+			K key;
+			recordKey(*reinterpret_cast<const RECORD*>(scan.getRecord().data()), key);
+			expected[key] = scanRid;
+			keys.push_back(key);
+		}
+	}
+	const std::map<K, RecordId> all(expected);
+	const std::vector<K> probes(keys);
+
+	std::string indexName;
+	{
+		BTreeIndex index(relationName, indexName, &pool, attrByteOffset, attrType, BULK_BUILD, 0.01);
+		errors += indexContentsCheck(&index, expected, probes, keyPointer(low), keyPointer(high));
+	}
+	if (rootLevel<T>(indexName) != 0)
+		errors++;
+
+	std::mt19937 random(numRecords);
+	std::shuffle(keys.begin(), keys.end(), random);
+	{
+		BTreeIndex index(relationName, indexName, &pool, attrByteOffset, attrType);
+		for (std::size_t i = 0; i < keys.size(); i++)
+		{
+			if (!index.deleteEntry(keyPointer(keys[i]), all.find(keys[i])->second))
+				errors++;
+			expected.erase(keys[i]);
+			if ((i + 1) % (keys.size() / 8) == 0 || i + 1 == keys.size())
+				errors += indexContentsCheck(&index, expected, probes, keyPointer(low), keyPointer(high));
+		}
+	}
+	// only the root and a single empty leaf are left
+	if (rootLevel<T>(indexName) != 1)
+		errors++;
+	const std::streamoff fileSize = std::ifstream(indexName, std::ios::binary | std::ios::ate).tellg();
+
+	std::shuffle(keys.begin(), keys.end(), random);
+	{
+		BTreeIndex index(relationName, indexName, &pool, attrByteOffset, attrType);
+		for (std::size_t i = 0; i < keys.size(); i++)
+			index.insertEntry(keyPointer(keys[i]), all.find(keys[i])->second);
+		errors += indexContentsCheck(&index, all, probes, keyPointer(low), keyPointer(high));
+	}
+	if (std::ifstream(indexName, std::ios::binary | std::ios::ate).tellg() > fileSize)
+		errors++;
+
+	File::remove(indexName);
+	File::remove(relationName);
+	return errors;
+}
+
+void mappedThroughput(int numRecords, int numLookups)
+{
+	// scan a relation and look up random keys in an index on it, with the files read with pread and
+	// then through a memory mapping. Small pools make most pages come from the files.
+	std::string indexName;
+	createRelationOfSize(relationName, numRecords);
+	{
+		BufMgr pool(1000);
+		BTreeIndex index(relationName, indexName, &pool, offsetof(tuple,i), INTEGER);
+	}
+
+	for (int mapped = 0; mapped < 2; mapped++)
+	{
+		File::setMemoryMapped(mapped);
+		BufMgr pool(64);
+		int numScanned = 0;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		{
+			FileScan scan(relationName, &pool);
+			RecordId scanRid;
+			while (scan.tryScanNext(scanRid))
+				numScanned++;
+		}
+		double scanSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		int numFound = 0;
+		BTreeIndex index(relationName, indexName, &pool, offsetof(tuple,i), INTEGER);
+		std::mt19937 random(numLookups);
+		start = std::chrono::steady_clock::now();
+		for (int i = 0; i < numLookups; i++)
+		{
+			int key = random() % numRecords;
+			std::vector<RecordId> rids;
+			index.lookup(&key, rids);
+			numFound += rids.size();
+		}
+		double lookupSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		std::cout << (mapped ? "mapped" : "pread") << " files: " << (long)(numScanned / scanSeconds) << " records scanned/s, "
+			<< (long)(numLookups / lookupSeconds) << " index lookups/s"
+			<< (numScanned == numRecords && numFound == numLookups ? "" : " (records missing)") << std::endl;
+	}
+	File::setMemoryMapped(false);
+	File::remove(indexName);
+	File::remove(relationName);
+}
+
+int pageRecordCheck(int numRounds)
+{
+	// fill a page with records of different lengths and delete some of them, which shifts the records
+	// stored before them. The records left must read the same as copies and in place.
+	int errors = 0;
+	Page page;
+	std::vector<RecordId> rids;
+	std::vector<std::string> records;
+	for (int i = 0; ; i++)
+	{
+		std::string data(10 + i % 50, (char)('a' + i % 26));
+		RecordId recordId;
+		if (!page.tryInsertRecord(data, recordId))
+			break;
+		rids.push_back(recordId);
+		records.push_back(data);
+	}
+	for (std::size_t i = 0; i < rids.size(); i += 3)
+	{
+		page.deleteRecord(rids[i]);
+		records[i].clear();
+	}
+
+	std::size_t numRecords = 0;
+	for (PageIterator iter = page.begin(); iter != page.end(); ++iter)
+	{
+		RecordId recordId = iter.getCurrentRecord();
+		RecordView view = iter.getRecordView();
+		const std::string& expected = records[recordId.slot_number - 1];
+		if (*iter != expected || view.size() != expected.size() || memcmp(view.data(), expected.data(), view.size()) != 0)
+			errors++;
+		numRecords++;
+	}
+	if (numRecords != rids.size() - (rids.size() + 2) / 3)
+		errors++;
+
+	// read every record of the page as a copy and in place
+	std::size_t bytes = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int round = 0; round < numRounds; round++)
+		for (PageIterator iter = page.begin(); iter != page.end(); ++iter)
+			bytes += (*iter).size();
+	double copySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	start = std::chrono::steady_clock::now();
+	for (int round = 0; round < numRounds; round++)
+		for (PageIterator iter = page.begin(); iter != page.end(); ++iter)
+			bytes -= iter.getRecordView().size();
+	double viewSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (bytes != 0)
+		errors++;
+
+	std::cout << "reading records: " << (long)(numRounds * numRecords / copySeconds) << " copies/s, "
+		<< (long)(numRounds * numRecords / viewSeconds) << " in place/s" << std::endl;
+	return errors;
+}
+
+int scanCount(BufMgr *pool, const std::vector<ScanPredicate> &predicates)
+{
+	FileScan scan(relationName, pool);
+	for (std::size_t i = 0; i < predicates.size(); i++)
+		scan.addPredicate(predicates[i]);
+	int numFound = 0;
+	RecordId scanRid;
+	while (scan.tryScanNext(scanRid))
+		numFound++;
+	return numFound;
+}
+
+int scanPushdownCheck(int numRecords)
+{
+	// scan a relation with predicates on each type of attribute, and project the records that match.
+	// Then time a scan that keeps one record in a hundred, filtering on the page and after copying.
+	int errors = 0;
+	createRelationOfSize(relationName, numRecords);
+	BufMgr pool(64);
+	char key[sizeof(record1.s)];
+	sprintf(key, "%05d string record", numRecords / 2);
+
+	std::vector<ScanPredicate> range;
+	range.push_back(ScanPredicate(offsetof(RECORD, i), GTE, numRecords / 4));
+	range.push_back(ScanPredicate(offsetof(RECORD, i), LT, numRecords / 2));
+	if (scanCount(&pool, range) != numRecords / 2 - numRecords / 4)
+		errors++;
+	if (scanCount(&pool, std::vector<ScanPredicate>(1, ScanPredicate(offsetof(RECORD, d), EQ, 7.0))) != 1)
+		errors++;
+	if (scanCount(&pool, std::vector<ScanPredicate>(1, ScanPredicate(offsetof(RECORD, s), EQ, key, sizeof(record1.s)))) != 1)
+		errors++;
+	if (scanCount(&pool, std::vector<ScanPredicate>(1, ScanPredicate(offsetof(RECORD, s), NE, key, sizeof(record1.s)))) != numRecords - 1)
+		errors++;
+	if (scanCount(&pool, std::vector<ScanPredicate>(1, ScanPredicate(offsetof(RECORD, s), LT, std::string("00010"), 5))) != 10)
+		errors++;
+
+	{
+		// project the double and then the int of the records in range
+		FileScan scan(relationName, &pool);
+		scan.addPredicate(range[0]);
+		scan.addPredicate(range[1]);
+		std::vector<ScanAttribute> attributes;
+		ScanAttribute d = { offsetof(RECORD, d), sizeof(double) };
+		ScanAttribute i = { offsetof(RECORD, i), sizeof(int) };
+		attributes.push_back(d);
+		attributes.push_back(i);
+		scan.setProjection(attributes);
+		int expected = numRecords / 4;
+		RecordId scanRid;
+		while (scan.tryScanNext(scanRid))
+		{
+			const std::string &projected = scan.getProjectedRecord();
+			double dValue;
+			int iValue;
+			memcpy(&dValue, projected.data(), sizeof(dValue));
+			memcpy(&iValue, projected.data() + sizeof(dValue), sizeof(iValue));
+			if (projected.size() != sizeof(double) + sizeof(int) || dValue != (double)expected || iValue != expected)
+				errors++;
+			expected++;
+		}
+		if (expected != numRecords / 2)
+			errors++;
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	int numPushed = scanCount(&pool, std::vector<ScanPredicate>(1, ScanPredicate(offsetof(RECORD, i), LT, numRecords / 100)));
+	double pushedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	int numCopied = 0;
+	start = std::chrono::steady_clock::now();
+	{
+		FileScan scan(relationName, &pool);
+		RecordId scanRid;
+		while (scan.tryScanNext(scanRid))
+		{
+			std::string recordStr = scan.getRecord();
+			if (reinterpret_cast<const RECORD*>(recordStr.data())->i < numRecords / 100)
+				numCopied++;
+		}
+	}
+	double copiedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (numPushed != numRecords / 100 || numCopied != numPushed)
+		errors++;
+
+	std::cout << "scanning for 1% of records: " << (long)(numRecords / pushedSeconds) << " records/s tested on the page, "
+		<< (long)(numRecords / copiedSeconds) << " records/s copied" << std::endl;
+	File::remove(relationName);
+	return errors;
+}
+
+int scanBatchCheck(int numRecords)
+{
+	// read a relation in batches, whole and projected onto the int, which must hold the same records
+	// in the same order as a scan a record at a time. Then time summing the ints each way.
+	int errors = 0;
+	createRelationOfSize(relationName, numRecords);
+	BufMgr pool(64);
+	{
+		FileScan scan(relationName, &pool);
+		FileScan batchScan(relationName, &pool);
+		RecordBatch batch(100);
+		RecordId scanRid;
+		int numScanned = 0;
+		while (batchScan.nextBatch(batch))
+		{
+			if (batch.size() != 100 && numScanned + (int)batch.size() != numRecords)
+				errors++;
+			for (std::size_t i = 0; i < batch.size(); i++, numScanned++)
+			{
+				if (!scan.tryScanNext(scanRid) || scanRid != batch.getRecordId(i) ||
+						scan.getRecord() != batch.getRecord(i).str())
+					errors++;
+			}
+		}
+		if (numScanned != numRecords || scan.tryScanNext(scanRid))
+			errors++;
+	}
+
+	ScanAttribute iAttr = { offsetof(RECORD, i), sizeof(int) };
+	long long expectedSum = (long long)numRecords * (numRecords - 1) / 2;
+	long long sum = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	{
+		FileScan scan(relationName, &pool);
+		RecordId scanRid;
+		while (scan.tryScanNext(scanRid))
+		{
+			std::string recordStr = scan.getRecord();
+			sum += reinterpret_cast<const RECORD*>(recordStr.data())->i;
+		}
+	}
+	double recordSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (sum != expectedSum)
+		errors++;
+
+	sum = 0;
+	start = std::chrono::steady_clock::now();
+	{
+		FileScan scan(relationName, &pool);
+		RecordBatch batch;
+		while (scan.nextBatch(batch))
+		{
+			for (std::size_t i = 0; i < batch.size(); i++)
+			{
+				int value;
+				memcpy(&value, batch.getRecord(i).data() + iAttr.attrByteOffset, sizeof(value));
+				sum += value;
+			}
+		}
+	}
+	double batchSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (sum != expectedSum)
+		errors++;
+
+	// projected onto the int, the records of a batch make up an array of ints
+	sum = 0;
+	start = std::chrono::steady_clock::now();
+	{
+		FileScan scan(relationName, &pool);
+		scan.setProjection(std::vector<ScanAttribute>(1, iAttr));
+		RecordBatch batch;
+		std::vector<int> column;
+		while (scan.nextBatch(batch))
+		{
+			column.resize(batch.size());
+			if (batch.size() > 0)
+				memcpy(&column[0], batch.getRecord(0).data(), batch.size() * sizeof(int));
+			for (std::size_t i = 0; i < column.size(); i++)
+				sum += column[i];
+		}
+	}
+	double columnSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (sum != expectedSum)
+		errors++;
+
+	std::cout << "summing a column: " << (long)(numRecords / recordSeconds) << " rows/s a record at a time, "
+		<< (long)(numRecords / batchSeconds) << " rows/s in batches, " << (long)(numRecords / columnSeconds)
+		<< " rows/s in projected batches" << std::endl;
+	File::remove(relationName);
+	return errors;
+}
+
+int parallelScanCheck(int numRecords)
+{
+	// delete some pages of a relation, then scan it with several workers in order and out of order. The
+	// records found must be those a single FileScan finds, in the same order for the scan in order.
+	// Then time a full scan with more and more workers.
+	int errors = 0;
+	createRelationOfSize(relationName, numRecords);
+	{
+		PageFile relation = PageFile::open(relationName);
+		relation.deletePage(3);
+		relation.deletePage(MORSELSIZE * 2);
+		relation.deletePage(MORSELSIZE * 2 + 1);
+	}
+	BufMgr pool(256);
+	ScanPredicate predicate(offsetof(RECORD, i), NE, 5);
+	ScanAttribute iAttr = { offsetof(RECORD, i), sizeof(int) };
+	std::vector<RecordId> expected;
+	long long expectedSum = 0;
+	{
+		FileScan scan(relationName, &pool);
+		scan.addPredicate(predicate);
+		RecordId scanRid;
+		while (scan.tryScanNext(scanRid))
+		{
+			expected.push_back(scanRid);
+			expectedSum += reinterpret_cast<const RECORD*>(scan.getRecord().data())->i;
+		}
+	}
+
+	for (int ordered = 1; ordered >= 0; ordered--)
+	{
+		std::mutex found;
+		std::vector<RecordId> rids;
+		long long sum = 0;
+		{
+			ParallelFileScan scan(relationName, &pool, 4);
+			scan.addPredicate(predicate);
+			scan.setProjection(std::vector<ScanAttribute>(1, iAttr));
+			scan.scan([&](const RecordBatch &batch)
+			{
+				std::lock_guard<std::mutex> guard(found);
+				for (std::size_t i = 0; i < batch.size(); i++)
+				{
+					int value;
+					memcpy(&value, batch.getRecord(i).data(), sizeof(value));
+					sum += value;
+					rids.push_back(batch.getRecordId(i));
+				}
+			}, ordered);
+		}
+		if (!ordered)
+		{
+			std::sort(rids.begin(), rids.end(), [](const RecordId &a, const RecordId &b)
+			{
+				return a.page_number < b.page_number || (a.page_number == b.page_number && a.slot_number < b.slot_number);
+			});
+		}
+		if (rids != expected || sum != expectedSum)
+			errors++;
+	}
+
+	// an exception thrown by the consumer stops the scan
+	bool stopped = false;
+	try
+	{
+		ParallelFileScan scan(relationName, &pool, 4);
+		scan.scan([](const RecordBatch &) { throw EndOfFileException(); }, true);
+	}
+	catch (const EndOfFileException &)
+	{
+		stopped = true;
+	}
+	if (!stopped)
+		errors++;
+
+	std::cout << "scanning in parallel:";
+	for (unsigned numThreads = 1; numThreads <= 4; numThreads *= 2)
+	{
+		std::atomic<long long> numScanned(0);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		{
+			ParallelFileScan scan(relationName, &pool, numThreads);
+			scan.scan([&](const RecordBatch &batch) { numScanned += batch.size(); });
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (numScanned != (long long)expected.size() + 1)
+			errors++;
+		std::cout << " " << (long)(numScanned / seconds) << " rows/s with " << numThreads << " workers,";
+	}
+	std::cout << " on " << std::thread::hardware_concurrency() << " hardware threads" << std::endl;
+
+	File::remove(relationName);
+	return errors;
+}
+
+int parallelBuildCheck(int numRecords)
+{
+	// build indexes on each attribute of a relation with some deleted pages both with a single thread and
+	// in parallel. Both indexes must return the same record ids in the same order, and the parallel one
+	// must keep working once entries are inserted. Then time the builds of an integer index.
+	int errors = 0;
+	createRelationOfSize(relationName, numRecords);
+	{
+		PageFile relation = PageFile::open(relationName);
+		relation.deletePage(3);
+		relation.deletePage(MORSELSIZE * 2);
+	}
+	BufMgr pool(256);
+	const int numScanned = scanCount(&pool, std::vector<ScanPredicate>());
+
+	const int lowInt = -1, highInt = numRecords;
+	const double lowDouble = -1, highDouble = numRecords;
+	const char lowString[] = "", highString[] = "~";
+	const int offsets[] = { offsetof(RECORD, i), offsetof(RECORD, d), offsetof(RECORD, s) };
+	const Datatype types[] = { INTEGER, DOUBLE, STRING };
+	const void *lows[] = { &lowInt, &lowDouble, lowString };
+	const void *highs[] = { &highInt, &highDouble, highString };
+
+	for (int attr = 0; attr < 3; attr++)
+	{
+		std::vector<RecordId> rids[2];
+		for (int parallel = 0; parallel < 2; parallel++)
+		{
+			std::string indexName;
+			{
+				BTreeIndex index(relationName, indexName, &pool, offsets[attr], types[attr],
+						parallel ? PARALLEL_BUILD : BULK_BUILD, DEFAULTFILLFACTOR, DEFAULTMERGETHRESHOLD, 4);
+				RecordId scanRid;
+				index.startScan(lows[attr], GTE, highs[attr], LTE);
+				try
+				{
+					while (1)
+					{
+						index.scanNext(scanRid);
+						rids[parallel].push_back(scanRid);
+					}
+				}
+				catch (const IndexScanCompletedException &e)
+				{
+				}
+				index.endScan();
+
+				if (parallel && types[attr] == INTEGER)
+				{
+					RecordId newRid = { 1, 1, 0 };
+					for (int key = numRecords; key < numRecords + 1000; key++)
+						index.insertEntry(&key, newRid);
+					for (int key = numRecords; key < numRecords + 1000; key += 7)
+					{
+						std::vector<RecordId> found;
+						index.lookup(&key, found);
+						if (found.size() != 1)
+							errors++;
+					}
+				}
+			}
+			File::remove(indexName);
+		}
+		if (rids[0] != rids[1] || (int)rids[0].size() != numScanned)
+			errors++;
+	}
+
+	std::cout << "building an integer index: ";
+	const unsigned threadCounts[] = { 0, 1, 2, 4 };
+	for (int run = 0; run < 4; run++)
+	{
+		const unsigned numThreads = threadCounts[run];
+		std::string indexName;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		{
+			BTreeIndex index(relationName, indexName, &pool, offsetof(RECORD, i), INTEGER,
+					numThreads ? PARALLEL_BUILD : BULK_BUILD, DEFAULTFILLFACTOR, DEFAULTMERGETHRESHOLD, numThreads);
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		File::remove(indexName);
+		if (numThreads)
+			std::cout << ", " << seconds << "s with " << numThreads << " threads";
+		else
+			std::cout << seconds << "s bulk loading";
+	}
+	std::cout << " on " << std::thread::hardware_concurrency() << " hardware threads" << std::endl;
+
+	File::remove(relationName);
+	return errors;
 }
@@ -6,6 +6,7 @@
  */
 
 #include <cassert>
+#include <cstring>
 
 #include <iostream>
 #include "exceptions/insufficient_space_exception.h"
@@ -29,26 +30,39 @@ void Page::initialize() {
   header_.num_free_slots = 0;
   header_.current_page_number = INVALID_NUMBER;
   header_.next_page_number = INVALID_NUMBER;
+  header_.prev_page_number = INVALID_NUMBER;
   //data_.assign(DATA_SIZE, char());
 	memset(data_, '\0', DATA_SIZE);
 }
 
 RecordId Page::insertRecord(const std::string& record_data) {
-  if (!hasSpaceForRecord(record_data)) {
+  RecordId record_id;
+  if (!tryInsertRecord(record_data, record_id)) {
     throw InsufficientSpaceException(
         page_number(), record_data.length(), getFreeSpace());
   }
+  return record_id;
+}
+
+bool Page::tryInsertRecord(const std::string& record_data,
+                           RecordId& record_id) {
+  if (!hasSpaceForRecord(record_data)) {
+    return false;
+  }
   const SlotId slot_number = getAvailableSlot();
   insertRecordInSlot(slot_number, record_data);
-  return {page_number(), slot_number};
+  record_id = {page_number(), slot_number};
+  return true;
 }
 
 std::string Page::getRecord(const RecordId& record_id) const {
+  return getRecordView(record_id).str();
+}
+
+RecordView Page::getRecordView(const RecordId& record_id) const {
   validateRecordId(record_id);
   const PageSlot& slot = getSlot(record_id.slot_number);
-	std::string retStr = std::string(data_, DATA_SIZE).substr(slot.item_offset, slot.item_length);
-
-	return retStr;
+  return RecordView(&data_[slot.item_offset], slot.item_length);
 }
 
 void Page::updateRecord(const RecordId& record_id,
@@ -77,10 +91,7 @@ void Page::deleteRecord(const RecordId& record_id,
   validateRecordId(record_id);
   PageSlot* slot = getSlot(record_id.slot_number);
 
-	for(int i = 0; i < slot->item_length; i++)
-		data_[i + slot->item_offset] = '\0';
-
-  //data_.replace(slot->item_offset, slot->item_length, slot->item_length, '\0');
+  std::memset(&data_[slot->item_offset], '\0', slot->item_length);
 
   // Compact the data by removing the hole left by this record (if necessary).
   std::uint16_t move_offset = slot->item_offset; 
@@ -97,14 +108,11 @@ void Page::deleteRecord(const RecordId& record_id,
       other_slot->item_offset += slot->item_length;
     }
   }
-  // If we have data to move, shift it to the right.
+  // If we have data to move, shift it to the right.  The two ranges overlap
+  // when the record is shorter than the data before it.
   if (move_bytes > 0) {
-    const std::string& data_to_move = std::string(data_, DATA_SIZE).substr(move_offset, move_bytes);
-
-		for(std::uint16_t i = 0; i < move_bytes; i++)
-			data_[i + move_offset + slot->item_length] = data_to_move[i];
-
-    //data_.replace(move_offset + slot->item_length, move_bytes, data_to_move);
+    std::memmove(&data_[move_offset + slot->item_length], &data_[move_offset],
+                 move_bytes);
   }
   header_.free_space_upper_bound += slot->item_length;
 
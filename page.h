@@ -21,7 +21,7 @@ namespace badgerdb {
  * @brief Header metadata in a page.
  *
  * Header metadata in each page which tracks where space has been used and
- * contains a pointer to the next page in the file.
+ * contains pointers to the next and previous pages in the file.
  */
 struct PageHeader {
   /**
@@ -58,6 +58,12 @@ struct PageHeader {
    */
   PageId next_page_number;
 
+  /**
+   * Number of the previous used page in the file.  Free pages link to the
+   * previous free page instead.
+   */
+  PageId prev_page_number;
+
   /**
    * Returns true if this page header is equal to the other.
    *
@@ -68,7 +74,8 @@ struct PageHeader {
     return num_slots == rhs.num_slots &&
         num_free_slots == rhs.num_free_slots &&
         current_page_number == rhs.current_page_number &&
-        next_page_number == rhs.next_page_number;
+        next_page_number == rhs.next_page_number &&
+        prev_page_number == rhs.prev_page_number;
   }
 };
 
@@ -95,6 +102,48 @@ struct PageSlot {
 
 class PageIterator;
 
+/**
+ * @brief Bytes of a record read in place on a page, without copying them.
+ *
+ * A view only stays valid while the page it points into is neither changed
+ * nor, for a page in the buffer pool, unpinned.
+ */
+class RecordView {
+ public:
+  /**
+   * Constructs an empty view.
+   */
+  RecordView() : data_(NULL), size_(0) {}
+
+  /**
+   * Constructs a view of the given bytes.
+   *
+   * @param data  First byte of the record.
+   * @param size  Number of bytes in the record.
+   */
+  RecordView(const char* data, const std::size_t size)
+      : data_(data), size_(size) {}
+
+  /**
+   * Returns the first byte of the record.
+   */
+  const char* data() const { return data_; }
+
+  /**
+   * Returns the number of bytes in the record.
+   */
+  std::size_t size() const { return size_; }
+
+  /**
+   * Returns a copy of the record, which stays valid after the page changes.
+   */
+  std::string str() const { return std::string(data_, size_); }
+
+ private:
+  const char* data_;
+  std::size_t size_;
+};
+
 /**
  * @brief Class which represents a fixed-size database page containing records.
  *
@@ -141,6 +190,17 @@ class Page {
    */
   RecordId insertRecord(const std::string& record_data);
 
+  /**
+   * Inserts a new record into the page if it fits.  Unlike insertRecord,
+   * a full page is reported through the return value rather than an
+   * exception, so loaders can fill pages in a tight loop.
+   *
+   * @param record_data  Bytes that compose the record.
+   * @param record_id    Set to the ID of the newly inserted record.
+   * @return  Whether the record was inserted.
+   */
+  bool tryInsertRecord(const std::string& record_data, RecordId& record_id);
+
   /**
    * Returns the record with the given ID.  Returned data is a copy of what is
    * stored on the page; use updateRecord to change it.
@@ -151,6 +211,16 @@ class Page {
    */
   std::string getRecord(const RecordId& record_id) const;
 
+  /**
+   * Returns the record with the given ID in place on the page, rather than a
+   * copy.  The view is only valid until the page changes.
+   *
+   * @see getRecord
+   * @param record_id  ID of the record to return.
+   * @return  The record.
+   */
+  RecordView getRecordView(const RecordId& record_id) const;
+
   /**
    * Updates the record with the given ID, replacing its data with a new
    * version.  This is equivalent to deleting the old record and inserting a
@@ -200,6 +270,13 @@ class Page {
    */
   PageId next_page_number() const { return header_.next_page_number; }
 
+  /**
+   * Returns the number of the previous used page this page in its file.
+   *
+   * @return  Page number of previous used page in file.
+   */
+  PageId prev_page_number() const { return header_.prev_page_number; }
+
   /**
    * Returns an iterator at the first record in the page.
    *
@@ -239,6 +316,15 @@ class Page {
     header_.next_page_number = new_next_page_number;
   }
 
+  /**
+   * Sets the number of the previous used page before this page in its file.
+   *
+   * @param prev_page_number  Page number of previous used page in file.
+   */
+  void set_prev_page_number(const PageId new_prev_page_number) {
+    header_.prev_page_number = new_prev_page_number;
+  }
+
   /**
    * Deletes the record with the given ID.  Page is compacted upon delete to
    * ensure that data of all records is contiguous.  Slot array is compacted if
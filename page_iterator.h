@@ -101,6 +101,16 @@ class PageIterator {
 		return page_->getRecord(current_record_); 
 	}
 
+  /**
+   * Returns the current record in place in the page rather than a copy.  The
+   * view is only valid until the page changes.
+   *
+   * @return  Record in page.
+   */
+	inline RecordView getRecordView() const {
+		return page_->getRecordView(current_record_);
+	}
+
   /**
    * Returns the next used slot in the page after the given slot or
    * Page::INVALID_SLOT if no slots are used after the given slot.
@@ -0,0 +1,239 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include <thread>
+#include "parallelscan.h"
+#include "page_iterator.h"
+#include "exceptions/invalid_page_exception.h"
+
+namespace badgerdb {
+
+ParallelFileScan::ParallelFileScan(const std::string &name, BufMgr *bufferMgr, const unsigned threads)
+{
+  file = new PageFile(name, false);	//dont create new file
+  bufMgr = bufferMgr;
+  numThreads = threads > 0 ? threads : std::max(std::thread::hardware_concurrency(), 1u);
+  nextMorsel = 0;
+  ordered = false;
+}
+
+ParallelFileScan::~ParallelFileScan()
+{
+  bufMgr->flushFile(file);
+  delete file;
+}
+
+void ParallelFileScan::addPredicate(const ScanPredicate& predicate)
+{
+  predicates.push_back(predicate);
+}
+
+void ParallelFileScan::setProjection(const std::vector<ScanAttribute>& attributes)
+{
+  projection = attributes;
+}
+
+void ParallelFileScan::scan(const BatchConsumer& consume, const bool inOrder)
+{
+  // page 0 is the header, so morsel m holds the pages from 1 + m * MORSELSIZE
+  const PageId numPages = file->getNumPages();
+  const std::uint32_t numMorsels = (numPages - 1 + MORSELSIZE - 1) / MORSELSIZE;
+
+  // deal the morsels out in turn, so that the workers start at the front of the file together
+  queues.assign(numThreads, std::deque<std::uint32_t>());
+  for (std::uint32_t m = 0; m < numMorsels; m++)
+    queues[m % numThreads].push_back(m);
+  results.assign(inOrder ? numMorsels : 0, std::vector<RecordBatch>());
+  finished.assign(inOrder ? numMorsels : 0, false);
+  nextMorsel = 0;
+  ordered = inOrder;
+  error = std::exception_ptr();
+
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i < numThreads; i++)
+    workers.push_back(std::thread(&ParallelFileScan::work, this, i, numPages, std::cref(consume)));
+
+  if (ordered)
+  {
+    // hand out the batches of each morsel once it and every morsel before it have been scanned
+    std::unique_lock<std::mutex> guard(lock);
+    while (nextMorsel < numMorsels && !error)
+    {
+      changed.wait(guard, [&]() { return finished[nextMorsel] || error; });
+      if (error)
+        break;
+      std::vector<RecordBatch> batches;
+      batches.swap(results[nextMorsel]);
+      nextMorsel++;
+      changed.notify_all();
+
+      guard.unlock();
+      try
+      {
+        for (std::size_t i = 0; i < batches.size(); i++)
+          consume(batches[i]);
+      }
+      catch (...)
+      {
+        guard.lock();
+        if (!error)
+          error = std::current_exception();
+        changed.notify_all();
+        break;
+      }
+      guard.lock();
+    }
+  }
+
+  for (std::size_t i = 0; i < workers.size(); i++)
+    workers[i].join();
+  results.clear();
+  if (error)
+    std::rethrow_exception(error);
+}
+
+bool ParallelFileScan::takeFrom(std::deque<std::uint32_t>& queue, const bool front, std::uint32_t& morsel)
+{
+  if (queue.empty())
+    return false;
+  const std::uint32_t candidate = front ? queue.front() : queue.back();
+  // in order, scanning too far ahead of the batches handed out would keep the batches of the whole file
+  if (ordered && candidate >= nextMorsel + MORSELWINDOW * numThreads)
+    return false;
+  morsel = candidate;
+  if (front)
+    queue.pop_front();
+  else
+    queue.pop_back();
+  return true;
+}
+
+bool ParallelFileScan::takeMorsel(const unsigned worker, std::uint32_t& morsel, std::unique_lock<std::mutex>& guard)
+{
+  while (!error)
+  {
+    if (takeFrom(queues[worker], true, morsel))
+      return true;
+
+    // steal from the back of another queue, or from its front if the back is too far ahead, which
+    // always finds the next morsel in order if it is waiting in a queue
+    bool left = !queues[worker].empty();
+    for (unsigned i = 1; i < numThreads; i++)
+    {
+      std::deque<std::uint32_t>& queue = queues[(worker + i) % numThreads];
+      if (takeFrom(queue, false, morsel) || takeFrom(queue, true, morsel))
+        return true;
+      left = left || !queue.empty();
+    }
+    if (!left)
+      return false;
+    changed.wait(guard);
+  }
+  return false;
+}
+
+void ParallelFileScan::work(const unsigned worker, const PageId numPages, const BatchConsumer& consume)
+{
+  // a ring of its own keeps each worker from replacing the rest of the buffer pool
+  BufRing ring(BUFRINGSIZE);
+  std::unique_lock<std::mutex> guard(lock);
+  try
+  {
+    std::uint32_t morsel;
+    while (takeMorsel(worker, morsel, guard))
+    {
+      guard.unlock();
+      std::vector<RecordBatch> batches;
+      if (ordered)
+      {
+        scanMorsel(morsel, numPages, ring, [&](RecordBatch& batch)
+        {
+          batches.push_back(std::move(batch));
+          batch = RecordBatch();
+        });
+      }
+      else
+      {
+        scanMorsel(morsel, numPages, ring, [&](RecordBatch& batch)
+        {
+          consume(batch);
+          batch.clear();
+        });
+      }
+      guard.lock();
+
+      if (ordered)
+      {
+        results[morsel].swap(batches);
+        finished[morsel] = true;
+      }
+      changed.notify_all();
+    }
+  }
+  catch (...)
+  {
+    if (!guard.owns_lock())
+      guard.lock();
+    if (!error)
+      error = std::current_exception();
+    changed.notify_all();
+  }
+}
+
+void ParallelFileScan::scanMorsel(const std::uint32_t morsel, const PageId numPages, BufRing& ring,
+                                  const std::function<void(RecordBatch&)>& emit)
+{
+  const PageId first = 1 + morsel * MORSELSIZE;
+  const PageId last = std::min(first + MORSELSIZE, numPages);
+  file->adviseWillNeed(first, last - first);
+
+  RecordBatch batch;
+  for (PageId pageNo = first; pageNo < last; pageNo++)
+  {
+    Page* page;
+    try
+    {
+      bufMgr->readPage(file, pageNo, page, &ring);
+    }
+    catch (const InvalidPageException&)
+    {
+      // a free page holds no records
+      continue;
+    }
+
+    try
+    {
+      for (PageIterator iter = page->begin(); iter != page->end(); ++iter)
+      {
+        RecordView record = iter.getRecordView();
+        bool matches = true;
+        for (std::size_t i = 0; i < predicates.size() && matches; i++)
+          matches = predicates[i].matches(record);
+        if (!matches)
+          continue;
+
+        if (batch.size() == batch.capacity())
+          emit(batch);
+        if (projection.empty())
+          batch.append(iter.getCurrentRecord(), record);
+        else
+          batch.append(iter.getCurrentRecord(), record, projection);
+      }
+    }
+    catch (...)
+    {
+      bufMgr->unPinPage(file, pageNo, false);
+      throw;
+    }
+    bufMgr->unPinPage(file, pageNo, false);
+  }
+  if (batch.size() > 0)
+    emit(batch);
+}
+
+}
@@ -0,0 +1,149 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "buffer.h"
+#include "file.h"
+#include "filescan.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Number of consecutive pages in a morsel, the unit of work of a ParallelFileScan.
+ */
+const PageId MORSELSIZE = 16;
+
+/**
+ * @brief Number of morsels per worker a ParallelFileScan in order may scan ahead of the morsel it is
+ * waiting to hand out.
+ */
+const std::uint32_t MORSELWINDOW = 4;
+
+/**
+ * @brief This class is used to scan the records of a relation with several threads.
+ *
+ * The pages of the file are split into morsels of MORSELSIZE consecutive pages, which are dealt out in
+ * turn to the queues of the workers. A worker takes morsels from the front of its own queue and, once it
+ * is empty, steals them from the back of the others. Each worker reads its pages through the buffer
+ * manager into a ring of its own, and tests the predicates of the scan in place on the pinned page.
+ */
+class ParallelFileScan
+{
+ public:
+  /**
+   * Called with each batch of records that satisfy the scan
+   */
+  typedef std::function<void(const RecordBatch&)> BatchConsumer;
+
+  //numThreads is the number of workers; 0 uses one per hardware thread
+  ParallelFileScan(const std::string &name, BufMgr *bufMgr, const unsigned numThreads = 0);
+
+  ~ParallelFileScan();
+
+  //only return records for which the predicate holds, along with every predicate added before
+  void addPredicate(const ScanPredicate& predicate);
+
+  //keep only the given attributes of each record, in the order given
+  void setProjection(const std::vector<ScanAttribute>& attributes);
+
+  //scan the whole file, handing every batch of records that satisfy the scan to consume. In order, the
+  //batches are handed over from the calling thread in the order of the file's pages. Otherwise they are
+  //handed over from the workers as soon as they are filled, so consume may be called from several
+  //threads at once. An exception thrown by a worker or by consume stops the scan and is rethrown.
+  void scan(const BatchConsumer& consume, const bool ordered = false);
+
+ private:
+  /**
+   * File which is being scanned
+   */
+  PageFile      *file;
+
+  /**
+   * Buffer Manager instance used to read pages into the buffer pool
+   */
+  BufMgr        *bufMgr;
+
+  /**
+   * Number of workers
+   */
+  unsigned      numThreads;
+
+  /**
+   * Predicates every record returned satisfies, and attributes kept by the projection
+   */
+  std::vector<ScanPredicate> predicates;
+  std::vector<ScanAttribute> projection;
+
+  /**
+   * Held while the state of the running scan below is used
+   */
+  std::mutex    lock;
+
+  /**
+   * Signalled when a morsel is taken or finished, the next morsel in order is handed out, or the scan stops
+   */
+  std::condition_variable changed;
+
+  /**
+   * Morsels waiting to be scanned by each worker, in increasing order
+   */
+  std::vector<std::deque<std::uint32_t> > queues;
+
+  /**
+   * For a scan in order, the batches of each morsel and whether it has been scanned
+   */
+  std::vector<std::vector<RecordBatch> > results;
+  std::vector<bool> finished;
+
+  /**
+   * For a scan in order, the next morsel to be handed out
+   */
+  std::uint32_t nextMorsel;
+
+  /**
+   * True if the batches are handed out in order
+   */
+  bool          ordered;
+
+  /**
+   * First exception thrown by a worker or the consumer, which stops the scan
+   */
+  std::exception_ptr error;
+
+  /**
+   * Take a morsel for the worker, waiting while a scan in order is too far ahead. Returns false once no
+   * morsels are left or the scan has stopped. The caller holds the lock.
+   */
+  bool takeMorsel(const unsigned worker, std::uint32_t& morsel, std::unique_lock<std::mutex>& guard);
+
+  /**
+   * Take a morsel from the front or back of a queue if a scan in order may scan it yet
+   */
+  bool takeFrom(std::deque<std::uint32_t>& queue, const bool front, std::uint32_t& morsel);
+
+  /**
+   * Scan morsels until none are left
+   */
+  void work(const unsigned worker, const PageId numPages, const BatchConsumer& consume);
+
+  /**
+   * Scan the pages of a morsel, passing each full batch to emit, and the last one even if it is not full
+   */
+  void scanMorsel(const std::uint32_t morsel, const PageId numPages, BufRing& ring,
+                  const std::function<void(RecordBatch&)>& emit);
+};
+
+}
@@ -24,6 +24,30 @@ typedef std::uint16_t SlotId;
  */
 typedef std::uint32_t FrameId;
 
+/**
+ * @brief Datatype enumeration type.
+ */
+enum Datatype
+{
+	INTEGER = 0,
+	DOUBLE = 1,
+	STRING = 2
+};
+
+/**
+ * @brief Scan operations enumeration. Passed to BTreeIndex::startScan() method, which takes only the
+ * first four, and used in the predicates of a FileScan.
+ */
+enum Operator
+{ 
+	LT, 	/* Less Than */
+	LTE,	/* Less Than or Equal to */
+	GTE,	/* Greater Than or Equal to */
+	GT,		/* Greater Than */
+	EQ,		/* Equal to */
+	NE		/* Not Equal to */
+};
+
 /**
  * @brief Identifier for a record in a page.
  */